@@ -0,0 +1,16 @@
+/*
+    Goof2 - An optimizing brainfuck VM
+    Batch mode API declarations
+    Published under the GNU AGPL-3.0-or-later license
+*/
+// SPDX-License-Identifier: AGPL-3.0-or-later
+#pragma once
+#include <string>
+
+#include "runConfig.hxx"
+
+// Run one program over every regular file in inputDir. Each run gets a fresh tape, reads the file
+// as its input and writes its output to a file of the same name in outDir. The program is compiled
+// once and the inputs are spread over all cores. Returns 0 when every input ran cleanly.
+int runBatch(const std::string& code, const std::string& inputDir, const std::string& outDir,
+             const RunConfig& cfg);
@@ -27,6 +27,7 @@ struct ReplConfig {
     bool highlightChanges;
     bool searchActive;
     uint64_t searchValue;
+    goof2::FlushPolicy flush;
 };
 
 template <typename CellT>
@@ -74,9 +75,13 @@ inline void dumpMemory(const std::vector<CellT>& cells, size_t cellPtr,
 template <typename CellT>
 inline void executeExcept(std::vector<CellT>& cells, size_t& cellPtr, std::string& code,
                           bool optimize, int eof, bool dynamicSize, goof2::MemoryModel model,
-                          goof2::ProfileInfo* profile = nullptr, bool term = false) {
-    int ret = goof2::execute<CellT>(cells, cellPtr, code, optimize, eof, dynamicSize, term, model,
-                                    profile);
+                          goof2::ProfileInfo* profile = nullptr, bool term = false,
+                          goof2::FlushPolicy flush = goof2::FlushPolicy::Auto,
+                          goof2::CompileSession* session = nullptr) {
+    int ret = session ? goof2::execute<CellT>(cells, cellPtr, code, *session, optimize, eof,
+                                              dynamicSize, term, model, profile, flush)
+                      : goof2::execute<CellT>(cells, cellPtr, code, optimize, eof, dynamicSize,
+                                              term, model, profile, nullptr, flush);
     switch (ret) {
         case 1:
             std::cout << ansi::red << "ERROR:" << ansi::reset << " Unmatched close bracket"
@@ -0,0 +1,59 @@
+/*
+    Goof2 - An optimizing brainfuck VM
+    Execution settings shared by the non-interactive CLI modes
+    Published under the GNU AGPL-3.0-or-later license
+*/
+// SPDX-License-Identifier: AGPL-3.0-or-later
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+#include "vm.hxx"
+
+struct RunConfig {
+    bool optimize;
+    bool dynamicSize;
+    int eof;
+    size_t tapeSize;
+    int cellWidth;
+    goof2::MemoryModel model;
+    goof2::FlushPolicy flush;
+};
+
+// Parse a --flush mode name; returns false for an unknown name.
+inline bool parseFlushPolicy(std::string_view name, goof2::FlushPolicy& out) {
+    if (name == "auto") {
+        out = goof2::FlushPolicy::Auto;
+    } else if (name == "unbuffered") {
+        out = goof2::FlushPolicy::Unbuffered;
+    } else if (name == "line") {
+        out = goof2::FlushPolicy::Line;
+    } else if (name == "full") {
+        out = goof2::FlushPolicy::Full;
+    } else if (name == "before-input") {
+        out = goof2::FlushPolicy::BeforeInput;
+    } else if (name == "async") {
+        out = goof2::FlushPolicy::Async;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Parse an optimization level given as -O<name>; returns false for an unknown name.
+inline bool parseOptLevel(std::string_view name, goof2::OptLevel& out) {
+    if (name == "0") {
+        out = goof2::OptLevel::O0;
+    } else if (name == "1") {
+        out = goof2::OptLevel::O1;
+    } else if (name == "2") {
+        out = goof2::OptLevel::O2;
+    } else if (name == "3") {
+        out = goof2::OptLevel::O3;
+    } else if (name == "auto") {
+        out = goof2::OptLevel::Auto;
+    } else {
+        return false;
+    }
+    return true;
+}
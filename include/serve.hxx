@@ -0,0 +1,25 @@
+/*
+    Goof2 - An optimizing brainfuck VM
+    Server mode API declarations
+    Published under the GNU AGPL-3.0-or-later license
+*/
+// SPDX-License-Identifier: AGPL-3.0-or-later
+#pragma once
+#include <string>
+
+#include "runConfig.hxx"
+
+// Serve execution requests on a Unix domain socket until SIGINT or SIGTERM.
+//
+// Each connection carries one request: a header line
+//     <source bytes> <input bytes> [options]\n
+// followed by the source and then the input. Options use the CLI spellings
+// (-nopt, -dts, -eof N, -ts N, -cw N, -mm MODEL, --flush MODE). Program output is streamed back
+// line by line unless --flush says otherwise, and the connection is closed when the program ends.
+// Requests run concurrently on a thread pool, and compiled programs and loops stay cached between
+// them.
+//
+// A request carries at most 16 MiB of source and input, a client that sends or reads nothing for
+// 10 seconds is dropped, and a program is stopped after 2^32 instructions. Errors, including a
+// program that stops early, are sent back as a line starting with "ERROR: ".
+int runServer(const std::string& socketPath, const RunConfig& defaults);
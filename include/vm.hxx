@@ -23,11 +23,15 @@
 #include <cstddef>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "vm/io.hxx"
+#include "vm/loader.hxx"
 #include "vm/memory.hxx"
 
 enum class insType : uint8_t {
@@ -45,6 +49,12 @@ enum class insType : uint8_t {
     SCN_LFT,
     SCN_CLR_RGT,
     SCN_CLR_LFT,
+    STREAM_COPY,
+    WRITE_STR,
+    PUT_STR,
+    SKP_ZER,
+    DIVMOD,
+    MUL_PRD,
     END,
 };
 
@@ -60,22 +70,93 @@ namespace goof2 {
 
 enum class MemoryModel { Auto, Contiguous, Fibonacci, Paged, OSBacked };
 
+// How much work the compiler spends on a source. O0 only folds runs of the same command, O1 adds
+// clear and scan loops, O2 copy, multiply, divmod and pass-through loops and what is known of a
+// zeroed tape, and O3 fuses neighbouring instructions and runs the start of a program ahead.
+// Auto picks a level from the source size and a rough estimate of how long the program runs.
+enum class OptLevel { O0, O1, O2, O3, Auto };
+
 struct ProfileInfo {
     std::uint64_t instructions = 0;
+    std::uint64_t instructionLimit = 0;  // when not 0, the run stops with -1 after this many
     double seconds = 0.0;
     std::vector<std::uint64_t> loopCounts{};
     std::uint64_t heapBytes = 0;
+    double writerStallSeconds = 0.0;  // time spent waiting on the FlushPolicy::Async writer
+};
+
+// A loop the compiler left as a loop, at the byte offset of its '[' in the source.
+struct OptRemark {
+    std::size_t offset = 0;
+    std::string reason;
+};
+
+// What one compile did, filled in by compile() when given a report. Stage times are summed over
+// slices compiled in parallel; the clear, scan, comma and copy collections also run alongside
+// each other. Emit time excludes the loop cache lookups counted on their own.
+struct OptReport {
+    double filterSeconds = 0.0;
+    double balanceSeconds = 0.0;
+    double idiomSeconds = 0.0;
+    double streamSeconds = 0.0;
+    double divmodSeconds = 0.0;
+    double clearSeconds = 0.0;
+    double scanSeconds = 0.0;
+    double commaSeconds = 0.0;
+    double copySeconds = 0.0;
+    double rewriteSeconds = 0.0;
+    double setSeconds = 0.0;
+    double bracketSeconds = 0.0;
+    double emitSeconds = 0.0;
+    double loopCacheSeconds = 0.0;
+    double tapeSeconds = 0.0;
+    double evalSeconds = 0.0;
+    std::uint64_t clearLoops = 0;
+    std::uint64_t scanLoops = 0;
+    std::uint64_t copyLoops = 0;
+    std::uint64_t streamLoops = 0;
+    std::uint64_t divmodLoops = 0;
+    std::uint64_t commaTrims = 0;
+    std::uint64_t sets = 0;
+    std::uint64_t loopCacheHits = 0;
+    std::uint64_t loopCacheMisses = 0;
+    std::uint64_t loopsLeft = 0;
+    std::uint64_t deadLoops = 0;  // loops dropped because a fresh tape reaches them on a zero
+    std::uint64_t evalSteps = 0;  // instructions run at compile time in place of the program start
+    std::uint64_t outputRuns = 0;  // runs of output from several cells written as one block
+    std::vector<OptRemark> missed{};  // innermost loops left, in source order, with the reason
+    // How often each idiom loaded with loadIdioms() was replaced, by name in file order.
+    std::vector<std::pair<std::string, std::uint64_t>> idiomHits{};
 };
 
 struct CacheEntry {
     std::string source;
-    std::vector<instruction> instructions;
+    std::shared_ptr<std::vector<instruction>> instructions;
     std::list<size_t>::iterator usageIter;
     bool sparse = false;
 };
 
 using InstructionCache = std::unordered_map<size_t, CacheEntry>;
 
+// One slice of a source compiled in a CompileSession: the source text, the optimized text it was
+// rewritten to, its instructions with jumps unresolved and the pointer movement over it.
+struct CompiledSlice {
+    std::string source;
+    std::string optimized;
+    std::vector<instruction> instructions;
+    std::ptrdiff_t endPos = 0;
+    std::ptrdiff_t minPos = 0;
+    std::ptrdiff_t maxPos = 0;
+};
+
+// Compiler state kept between runs of related sources, as in the REPL. Sources run before come
+// from programs; others are cut after top-level loops and only slices not seen before are
+// compiled.
+struct CompileSession {
+    InstructionCache programs;
+    std::unordered_map<std::uint64_t, CompiledSlice> slices;
+};
+
 using LoopCache = std::unordered_map<std::uint64_t, std::vector<instruction>>;
 
 LoopCache& getLoopCache();
@@ -1,31 +1,48 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace goof2 {
 enum class MemoryModel;
+enum class OptLevel;
+enum class FlushPolicy;
+class IoSource;
+class IoSink;
 struct ProfileInfo;
+struct OptReport;
 struct CacheEntry;
+struct CompileSession;
+template <typename CellT>
+struct ForkedTape;
 using InstructionCache = std::unordered_map<size_t, CacheEntry>;
 
-/// @brief Only function you should use in your code. For now, it always prints to stdout.
+/// @brief Only function you should use in your code.
 /// @tparam CellT Cell width type (uint8_t, uint16_t, uint32_t, uint64_t)
 /// @param cells Vector of cells of type CellT.
 /// @param cellPtr
 /// @param code Remember that this will be modified, so if you need to do something else with your
 /// plaintext code, make a copy.
-/// @param optimize Enable optimizations (highly recommended). Set it here as an override, for the
-/// default state, check the GOOF2_OPTIMIZE define.
+/// @param optimize Enable optimizations (highly recommended), at the level set with setOptLevel().
+/// Set it here as an override, for the default state, check the GOOF2_OPTIMIZE define.
 /// @param eof EOF behaviour. 0 = cell unchanged, 1 = set to 0, 2 = set to 255. Check
 /// GOOF2_DEFAULT_EOF_BEHAVIOUR.
 /// @param dynamicSize Allow dynamic resizing of the cells vector. Disable if you want, for example,
 /// a constant number of decimals for a calculation, constant cell vector size. OOB on fixed size is
 /// currently not handled.
 /// @param term A few tweaks necessary to make it operable multiple times on the same cells. Check
-/// GOOF2_DEFAULT_SAVE_STATE.
+/// GOOF2_DEFAULT_SAVE_STATE. Cells that are not all zero are always run as if term were set.
 /// @param model Memory allocation strategy. `Auto` selects a model heuristically.
+/// @param flush When buffered output is written out. `Auto` flushes on newlines when stdout is a
+/// terminal, before reads when only stdin is one, and otherwise when the buffer fills. With an
+/// output sink, `Auto` only flushes when the buffer fills.
+/// @param input Source for `,`. When null, input comes from stdin, or from whatever streambuf
+/// std::cin has been redirected to.
+/// @param output Sink for `.`. When null, output goes to stdout, or to whatever streambuf std::cout
+/// has been redirected to. Runs that use their own source and sink can run concurrently.
 ///
 /// When dynamicSize is enabled the engine heuristically selects between a contiguous
 /// growth strategy, a Fibonacci-sized expansion scheme and a page-sized allocation
@@ -36,5 +53,62 @@ int execute(std::vector<CellT>& cells, size_t& cellPtr, std::string& code,
             bool optimize = GOOF2_OPTIMIZE, int eof = GOOF2_DEFAULT_EOF_BEHAVIOUR,
             bool dynamicSize = GOOF2_DYNAMIC_CELLS_SIZE, bool term = GOOF2_DEFAULT_SAVE_STATE,
             MemoryModel model = MemoryModel::Auto, ProfileInfo* profile = nullptr,
-            InstructionCache* cache = nullptr);
+            InstructionCache* cache = nullptr, FlushPolicy flush = FlushPolicy::Auto,
+            IoSource* input = nullptr, IoSink* output = nullptr);
+
+/// @brief Run code with the compiler state kept in session from earlier runs.
+///
+/// A source run before starts from its cached instructions. Any other source is cut after
+/// top-level loops, and only the slices the session has not compiled before are optimized, so
+/// small edits to a large program recompile only the loops around the edit. Parameters are as
+/// for the overload above. A session must not be used by two runs at once.
+template <typename CellT>
+int execute(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, CompileSession& session,
+            bool optimize = GOOF2_OPTIMIZE, int eof = GOOF2_DEFAULT_EOF_BEHAVIOUR,
+            bool dynamicSize = GOOF2_DYNAMIC_CELLS_SIZE, bool term = GOOF2_DEFAULT_SAVE_STATE,
+            MemoryModel model = MemoryModel::Auto, ProfileInfo* profile = nullptr,
+            FlushPolicy flush = FlushPolicy::Auto, IoSource* input = nullptr,
+            IoSink* output = nullptr);
+
+/// @brief Set about how many bytes each slice holds when a large source is compiled in slices on
+/// several threads; sources at least twice this size are sliced. The default is 262144.
+void setSliceSize(std::size_t bytes);
+
+/// @brief Set the optimization level used by runs that have optimize set; runs without it compile
+/// at O0. The default is O3. Programs compiled at one level are cached apart from the others.
+void setOptLevel(OptLevel level);
+
+/// @brief Set how many instructions O3 may run at compile time. A program that does not start on
+/// a kept tape is run ahead until its first read, its end or this budget, and that start is
+/// replaced by its output and the tape it leaves. 0 turns this off; the default is 1048576.
+void setEvalBudget(std::uint64_t steps);
+
+/// @brief Load loop idioms from the file at path, in place of any loaded before; an empty path
+/// drops them. Each line names an idiom, gives the shape of a loop with placeholders for its runs
+/// and what replaces it: a template in the same placeholders, `clear` or `divmod`. From O1 up,
+/// loops of those shapes are replaced before the built-in idioms are looked for.
+/// @return false with err set, keeping the idioms loaded before, when the file cannot be read or
+/// a line does not parse.
+bool loadIdioms(const std::string& path, std::string& err);
+
+/// @brief Compile code into `cache` without running it. A later execute() with the same code,
+/// settings and cache starts straight from the cached instructions.
+/// @param report When given and the code is not in `cache` yet, receives the time spent in each
+/// compile stage, the idioms found and the innermost loops left as loops, with the reason.
+/// @return 0 on success, 1 or 2 for an unmatched close or open bracket.
+template <typename CellT>
+int compile(std::string& code, InstructionCache& cache, bool optimize = GOOF2_OPTIMIZE,
+            int eof = GOOF2_DEFAULT_EOF_BEHAVIOUR, bool dynamicSize = GOOF2_DYNAMIC_CELLS_SIZE,
+            bool term = GOOF2_DEFAULT_SAVE_STATE, OptReport* report = nullptr);
+
+/// @brief Continue execution on a copy-on-write fork of a tape snapshot.
+///
+/// The tape is run in place on its private mapping, so untouched pages stay shared with the
+/// snapshot and every other fork. The tape is always dynamic and keeps state between calls (as if
+/// term were set). Returns -1 for an empty fork.
+template <typename CellT>
+int execute(ForkedTape<CellT>& tape, std::string& code, bool optimize = GOOF2_OPTIMIZE,
+            int eof = GOOF2_DEFAULT_EOF_BEHAVIOUR, ProfileInfo* profile = nullptr,
+            InstructionCache* cache = nullptr, FlushPolicy flush = FlushPolicy::Auto,
+            IoSource* input = nullptr, IoSink* output = nullptr);
 }  // namespace goof2
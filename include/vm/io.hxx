@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace goof2 {
+
+/// When buffered program output is written out.
+enum class FlushPolicy {
+    /// Full with a sink; otherwise Line on a terminal, else BeforeInput if stdin is one, else Full.
+    Auto,
+    Unbuffered,   ///< After every output instruction.
+    Line,         ///< On newline and before reading input.
+    Full,         ///< Only when the buffer fills and when execution ends.
+    BeforeInput,  ///< Before reading input and when the buffer fills or execution ends.
+    /// Like Full, but a background thread writes one buffer while the program fills the other.
+    Async,
+};
+
+/// Where a program's `,` reads come from. The VM pulls input in large blocks, so an
+/// implementation is called once per block rather than once per byte.
+class IoSource {
+   public:
+    virtual ~IoSource() = default;
+    /// Read up to size bytes into dst, blocking until at least one is available. 0 means EOF.
+    virtual size_t read(char* dst, size_t size) = 0;
+    /// Bytes that can be read in place without copying; empty if the source has no such view.
+    virtual std::string_view peek() { return {}; }
+    /// Mark the first n bytes returned by peek() as read.
+    virtual void consume(size_t) {}
+};
+
+/// Where a program's `.` output goes. Called with whole buffers, at the points chosen by the
+/// FlushPolicy.
+class IoSink {
+   public:
+    virtual ~IoSink() = default;
+    /// Write all of data; returning false drops the rest of the program's output.
+    virtual bool write(const char* data, size_t size) = 0;
+    /// Called after the buffered output has been written at a flush point.
+    virtual void flush() {}
+};
+
+/// Reads from memory; the VM consumes the bytes in place.
+class SpanSource final : public IoSource {
+   public:
+    explicit SpanSource(std::string_view data) : data(data) {}
+    size_t read(char* dst, size_t size) override {
+        const size_t n = std::min(size, data.size());
+        std::memcpy(dst, data.data(), n);
+        data.remove_prefix(n);
+        return n;
+    }
+    std::string_view peek() override { return data; }
+    void consume(size_t n) override { data.remove_prefix(n); }
+    /// Bytes not read yet.
+    std::string_view remaining() const { return data; }
+
+   private:
+    std::string_view data;
+};
+
+/// Appends to a string.
+class StringSink final : public IoSink {
+   public:
+    explicit StringSink(std::string& out) : out(out) {}
+    bool write(const char* data, size_t size) override {
+        out.append(data, size);
+        return true;
+    }
+
+   private:
+    std::string& out;
+};
+
+/// Fills a fixed buffer. Output past its end is dropped and the run's remaining output with it.
+class SpanSink final : public IoSink {
+   public:
+    explicit SpanSink(std::span<char> buf) : buf(buf) {}
+    bool write(const char* data, size_t size) override {
+        const size_t n = std::min(size, buf.size() - used);
+        std::memcpy(buf.data() + used, data, n);
+        used += n;
+        truncated |= n != size;
+        return !truncated;
+    }
+    size_t size() const { return used; }
+    bool overflowed() const { return truncated; }
+
+   private:
+    std::span<char> buf;
+    size_t used = 0;
+    bool truncated = false;
+};
+
+/// Reads a file descriptor, which stays owned by the caller.
+class FdSource final : public IoSource {
+   public:
+    explicit FdSource(int fd) : fd(fd) {}
+    size_t read(char* dst, size_t size) override;
+
+   private:
+    int fd;
+};
+
+/// Writes a file descriptor, which stays owned by the caller.
+class FdSink final : public IoSink {
+   public:
+    explicit FdSink(int fd) : fd(fd) {}
+    bool write(const char* data, size_t size) override;
+
+   private:
+    int fd;
+};
+
+/// Forwards to a function with the same contract as IoSource::read.
+class CallbackSource final : public IoSource {
+   public:
+    explicit CallbackSource(std::function<size_t(char*, size_t)> fn) : fn(std::move(fn)) {}
+    size_t read(char* dst, size_t size) override { return fn(dst, size); }
+
+   private:
+    std::function<size_t(char*, size_t)> fn;
+};
+
+/// Forwards to a function with the same contract as IoSink::write.
+class CallbackSink final : public IoSink {
+   public:
+    explicit CallbackSink(std::function<bool(const char*, size_t)> fn) : fn(std::move(fn)) {}
+    bool write(const char* data, size_t size) override { return fn(data, size); }
+
+   private:
+    std::function<bool(const char*, size_t)> fn;
+};
+
+/// Output buffer owned by one execute() call. Without a sink, writes go straight to file
+/// descriptor 1 unless std::cout has been redirected to another streambuf, in which case that
+/// buffer receives them. Pending output is flushed on destruction, so every exit path of the VM
+/// writes it out. With FlushPolicy::Async the writes happen on a helper thread, and the time the
+/// program spends waiting for it is added to *stallSeconds.
+class OutputBuffer {
+   public:
+    explicit OutputBuffer(FlushPolicy policy, IoSink* sink = nullptr,
+                          double* stallSeconds = nullptr);
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+    ~OutputBuffer();
+
+    void put(char ch, size_t count) {
+        if (count <= cap - len) [[likely]] {
+            std::memset(data + len, static_cast<unsigned char>(ch), count);
+            len += count;
+        } else {
+            putSlow(ch, count);
+        }
+        if (policy == FlushPolicy::Unbuffered || (policy == FlushPolicy::Line && ch == '\n'))
+            flush();
+    }
+    void beforeInput() {
+        if (policy != FlushPolicy::Full && policy != FlushPolicy::Async) flush();
+    }
+    /// Write a block of bytes; large blocks skip the buffer.
+    void putBlock(const char* bytes, size_t size);
+    void flush();
+
+   private:
+    struct AsyncWriter;
+
+    void putSlow(char ch, size_t count);
+    void drain();
+    void write(const char* bytes, size_t size);
+
+    FlushPolicy policy;
+    IoSink* sink;
+    std::streambuf* stream = nullptr;  // used when there is no sink; nullptr writes to fd 1
+    bool failed = false;
+    char* data;
+    size_t cap;
+    size_t len = 0;
+    std::unique_ptr<AsyncWriter> async;
+    double* stallSeconds;
+    std::array<char, 1 << 16> buf;
+};
+
+/// Input buffer owned by one execute() call. Without a source, standard input is mapped when it
+/// is a regular file and otherwise read in large blocks; bytes read ahead from a pipe or terminal
+/// are kept for the next call. When std::cin has been redirected, bytes come from that streambuf
+/// instead and are never read ahead. Nothing is touched until the program first reads.
+class InputBuffer {
+   public:
+    explicit InputBuffer(IoSource* source = nullptr) : source(source) {}
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+    ~InputBuffer();
+
+    /// Next byte, or -1 at end of input.
+    int get() {
+        if (pos != end) [[likely]]
+            return static_cast<unsigned char>(*pos++);
+        return getSlow();
+    }
+    /// Read up to count bytes into consecutive cells; returns how many were stored before EOF.
+    template <typename CellT>
+    size_t read(CellT* dst, size_t count) {
+        size_t done = 0;
+        while (done < count) {
+            if (pos == end && !refill(count - done)) break;
+            const size_t n = std::min(count - done, static_cast<size_t>(end - pos));
+            if constexpr (sizeof(CellT) == 1) {
+                std::memcpy(dst + done, pos, n);
+            } else {
+                for (size_t i = 0; i < n; ++i)
+                    dst[done + i] = static_cast<CellT>(static_cast<unsigned char>(pos[i]));
+            }
+            pos += n;
+            done += n;
+        }
+        return done;
+    }
+    /// Bytes buffered for reading, filling the buffer first if it is empty; empty at EOF. From a
+    /// redirected std::cin only what that streambuf has already buffered is taken.
+    std::string_view available() {
+        if (pos == end && !refillAvailable()) return {};
+        return {pos, static_cast<size_t>(end - pos)};
+    }
+    /// Mark the first n bytes returned by available() as read.
+    void skip(size_t n) { pos += n; }
+
+   private:
+    void init();
+    bool refillAvailable();
+    int getSlow();
+    bool refill(size_t want);
+
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    bool ready = false;
+    bool eof = false;
+    IoSource* source;
+    const char* window = nullptr;       // start of the source's peek() view being read
+    std::streambuf* stream = nullptr;  // used when there is no source; nullptr reads fd 0
+    std::vector<char> storage;
+    void* map = nullptr;
+    size_t mapSize = 0;
+    std::int64_t mapOffset = 0;  // file offset of map
+};
+}  // namespace goof2
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace goof2 {
+
+/// Copy the Brainfuck commands (+-<>[],.) in src to dst, dropping everything else. dst needs room
+/// for size bytes and may be src itself. Returns the number of bytes written.
+size_t filterSource(const char* src, size_t size, char* dst);
+
+/// Load a source file into out keeping only the Brainfuck commands. Regular files are mapped and
+/// filtered in 4 MiB chunks spread over worker threads, straight into the final string; anything
+/// else is read and filtered one block at a time. Returns false with err set, leaving out
+/// unchanged, when the file cannot be read.
+bool loadSource(const std::string& path, std::string& out, std::string& err);
+}  // namespace goof2
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
 
 namespace goof2 {
 #if GOOF2_HAS_OS_VM
@@ -8,5 +11,108 @@ void* defaultOsAlloc(size_t bytes);
 void defaultOsFree(void* ptr, size_t bytes);
 extern void* (*os_alloc)(size_t);
 extern void (*os_free)(void*, size_t);
+
+/// Immutable copy of a tape held in an anonymous shared-memory object (memfd on Linux, a
+/// pagefile-backed section on Windows). Every map() returns a private copy-on-write view, so any
+/// number of views share the physical pages until one of them writes.
+class TapeImage {
+   public:
+    TapeImage() = default;
+    TapeImage(const void* data, size_t bytes);
+    TapeImage(const TapeImage&) = delete;
+    TapeImage& operator=(const TapeImage&) = delete;
+    TapeImage(TapeImage&& other) noexcept { *this = std::move(other); }
+    TapeImage& operator=(TapeImage&& other) noexcept;
+    ~TapeImage() { close(); }
+
+    explicit operator bool() const { return handle != invalidHandle; }
+    size_t bytes() const { return size; }
+    /// Map a writable copy-on-write view of the image. Returns nullptr on failure.
+    void* map() const;
+    /// Release a view returned by map(); matches the os_free signature.
+    static void unmap(void* ptr, size_t bytes);
+
+   private:
+    void close();
+    static constexpr intptr_t invalidHandle = -1;
+    intptr_t handle = invalidHandle;  // fd on POSIX, HANDLE on Windows
+    size_t size = 0;
+};
+#endif
+
+/// Tape backed by a copy-on-write view of a TapeSnapshot. Run it with the ForkedTape overload of
+/// execute(). If the view ever has to fall back to heap memory the cells move into `spill`.
+template <typename CellT>
+struct ForkedTape {
+    CellT* data = nullptr;
+    size_t size = 0;
+    size_t cellPtr = 0;
+    void (*release)(void*, size_t) = nullptr;
+    std::vector<CellT> spill;
+
+    ForkedTape() = default;
+    ForkedTape(const ForkedTape&) = delete;
+    ForkedTape& operator=(const ForkedTape&) = delete;
+    ForkedTape(ForkedTape&& other) noexcept { *this = std::move(other); }
+    ForkedTape& operator=(ForkedTape&& other) noexcept {
+        if (this != &other) {
+            reset();
+            data = other.data;
+            size = other.size;
+            cellPtr = other.cellPtr;
+            release = other.release;
+            spill = std::move(other.spill);
+            other.data = nullptr;
+            other.size = 0;
+            other.release = nullptr;
+        }
+        return *this;
+    }
+    ~ForkedTape() { reset(); }
+
+    explicit operator bool() const { return data != nullptr; }
+    CellT& operator[](size_t i) { return data[i]; }
+    const CellT& operator[](size_t i) const { return data[i]; }
+    void reset() {
+        if (data && release) release(data, size * sizeof(CellT));
+        data = nullptr;
+        size = 0;
+        release = nullptr;
+        spill.clear();
+    }
+};
+
+#if GOOF2_HAS_OS_VM
+/// Snapshot of a tape and its cell pointer taken once, e.g. after a shared setup phase, and forked
+/// cheaply for every continuation. Forking costs one mmap regardless of the tape size.
+template <typename CellT>
+class TapeSnapshot {
+   public:
+    TapeSnapshot(const CellT* cells, size_t count, size_t cellPtr)
+        : image(cells, count * sizeof(CellT)), count(count), ptr(cellPtr) {}
+    TapeSnapshot(const std::vector<CellT>& cells, size_t cellPtr)
+        : TapeSnapshot(cells.data(), cells.size(), cellPtr) {}
+
+    explicit operator bool() const { return static_cast<bool>(image); }
+    size_t size() const { return count; }
+    size_t cellPtr() const { return ptr; }
+
+    /// Returns an empty ForkedTape if the view could not be mapped.
+    ForkedTape<CellT> fork() const {
+        ForkedTape<CellT> tape;
+        if (void* view = image.map()) {
+            tape.data = static_cast<CellT*>(view);
+            tape.size = count;
+            tape.cellPtr = ptr;
+            tape.release = &TapeImage::unmap;
+        }
+        return tape;
+    }
+
+   private:
+    TapeImage image;
+    size_t count;
+    size_t ptr;
+};
 #endif
 }  // namespace goof2
@@ -7,6 +7,7 @@
 #include <regex>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 using SvMatch = std::match_results<std::string_view::const_iterator>;
@@ -38,6 +39,29 @@ inline std::string processBalanced(std::string_view s, char no1, char no2) {
     return std::string(std::abs(total), total > 0 ? no1 : no2);
 }
 
+// Collapses every run of +/- and of >/< to its net effect. Scanned by hand: std::regex recurses
+// once per character of a match and overflows the stack on runs tens of thousands long.
+inline void balanceRuns(std::string& str) {
+    std::string result;
+    result.reserve(str.size());
+    for (size_t i = 0; i < str.size();) {
+        const char c = str[i];
+        const bool arith = c == '+' || c == '-';
+        if (!arith && c != '>' && c != '<') {
+            result += c;
+            ++i;
+            continue;
+        }
+        const char up = arith ? '+' : '>';
+        const char down = arith ? '-' : '<';
+        size_t j = i;
+        while (j < str.size() && (str[j] == up || str[j] == down)) ++j;
+        result += processBalanced(std::string_view(str).substr(i, j - i), up, down);
+        i = j;
+    }
+    str = std::move(result);
+}
+
 template <typename Callback>
 inline void regexReplaceInplace(std::string& str, const std::regex& re, Callback cb) {
     std::string_view sv{str};
@@ -84,10 +108,59 @@ inline std::pmr::vector<RegexReplacement> regexCollect(const std::string& str, c
     return reps;
 }
 
+// Rebuilds str with reps applied in one left-to-right pass and runs their side effects in source
+// order. Where matches overlap, the one starting first (or the longer at the same start) wins
+// and the others are dropped with their side effects. When removed is given, the ranges of the
+// applied replacements that leave no loop behind are added to it in order.
+inline void applyReplacements(std::string& str, std::pmr::vector<RegexReplacement>& reps,
+                              std::vector<std::pair<size_t, size_t>>* removed = nullptr) {
+    if (reps.empty()) return;
+    std::sort(reps.begin(), reps.end(), [](const auto& a, const auto& b) {
+        return a.start != b.start ? a.start < b.start : a.end > b.end;
+    });
+    std::string result;
+    result.reserve(str.size());
+    size_t last = 0;
+    for (auto& r : reps) {
+        if (r.start < last) continue;
+        result.append(str, last, r.start - last);
+        result += r.text;
+        if (removed && r.text.find('[') == std::string::npos) removed->emplace_back(r.start, r.end);
+        last = r.end;
+        if (r.sideEffect) r.sideEffect();
+    }
+    result.append(str, last, std::string::npos);
+    str = std::move(result);
+}
+
+// A loop shape read from an idiom file and what replaces it. Capture group k + 1 of pattern holds
+// the run slots[k] stands for: a letter naming a value, negated when it follows '<' or '-'.
+struct Idiom {
+    enum class Builtin { None, Clear, Divmod };
+    struct Slot {
+        char name;
+        bool negated;
+    };
+    std::string name;
+    std::regex pattern;
+    std::vector<Slot> slots;
+    Builtin builtin = Builtin::None;
+    std::string replacement;  // the template, with the pattern's placeholders, when not a builtin
+};
+
+// Parses the entries of an idiom file into out, in file order. Returns false with err naming the
+// line when one does not parse.
+bool parseIdioms(std::string_view text, std::vector<Idiom>& out, std::string& err);
+
+// Sets out to the text that replaces what, a match of idiom.pattern in code whose runs are
+// balanced. Returns false when a placeholder stands for two different values.
+bool expandIdiom(const Idiom& idiom, const SvMatch& what, std::string& out);
+
 namespace vmRegex {
 using namespace std::regex_constants;
 extern const std::regex nonInstructionRe;
-extern const std::regex balanceSeqRe;
+extern const std::regex streamCopyRe;
+extern const std::regex divmodRe;
 extern const std::regex clearLoopRe;
 extern const std::regex scanLoopClrRe;
 extern const std::regex scanLoopRe;
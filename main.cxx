@@ -10,13 +10,14 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include "ansi.hxx"
+#include "batch.hxx"
+#include "serve.hxx"
 #include "vm.hxx"
 #ifdef GOOF2_ENABLE_REPL
 #include "repl.hxx"
@@ -24,198 +25,30 @@
 
 #ifdef _WIN32
 #include <windows.h>
-#else
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <unistd.h>
 #endif
 
 namespace {
-// Cross-platform read-only file mapping and BF compaction
-struct MappedFile {
-    const char* data = nullptr;
-    size_t size = 0;
-#ifdef _WIN32
-    HANDLE hFile = INVALID_HANDLE_VALUE;
-    HANDLE hMap = nullptr;
-#else
-    int fd = -1;
-#endif
-    MappedFile() = default;
-    MappedFile(const MappedFile&) = delete;
-    MappedFile& operator=(const MappedFile&) = delete;
-    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
-    MappedFile& operator=(MappedFile&& other) noexcept {
-        if (this != &other) {
-            this->close();
-            data = other.data;
-            size = other.size;
-#ifdef _WIN32
-            hFile = other.hFile;
-            hMap = other.hMap;
-            other.hFile = INVALID_HANDLE_VALUE;
-            other.hMap = nullptr;
-#else
-            fd = other.fd;
-            other.fd = -1;
-#endif
-            other.data = nullptr;
-            other.size = 0;
-        }
-        return *this;
-    }
-    ~MappedFile() { close(); }
-    void close() {
-#ifdef _WIN32
-        if (data) UnmapViewOfFile((LPCVOID)data);
-        if (hMap) CloseHandle(hMap);
-        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
-        hFile = INVALID_HANDLE_VALUE;
-        hMap = nullptr;
-#else
-        if (data && size) {
-            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-            munmap(const_cast<char*>(data), size);
-        }
-        if (fd >= 0) ::close(fd);
-        fd = -1;
-#endif
-        data = nullptr;
-        size = 0;
-    }
-};
-
-#ifdef NDEBUG
-[[maybe_unused]]
-#endif
-constexpr std::array<bool, 256> bfTable = [] {
-    std::array<bool, 256> table{};
-    table[static_cast<unsigned char>('+')] = true;
-    table[static_cast<unsigned char>('-')] = true;
-    table[static_cast<unsigned char>('>')] = true;
-    table[static_cast<unsigned char>('<')] = true;
-    table[static_cast<unsigned char>('[')] = true;
-    table[static_cast<unsigned char>(']')] = true;
-    table[static_cast<unsigned char>('.')] = true;
-    table[static_cast<unsigned char>(',')] = true;
-    return table;
-}();
-
-static bool isBfChar(char c) { return bfTable[static_cast<unsigned char>(c)]; }
-
-static bool mapFileReadOnly(const std::string& path, MappedFile& mf) {
-#ifdef _WIN32
-    // Use narrow WinAPI for simplicity; CLI passes narrow paths
-    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
-                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
-    if (file == INVALID_HANDLE_VALUE) return false;
-    LARGE_INTEGER sz{};
-    if (!GetFileSizeEx(file, &sz)) {
-        CloseHandle(file);
-        return false;
-    }
-    if (sz.QuadPart == 0) {
-        mf.hFile = file;
-        mf.hMap = nullptr;
-        mf.data = nullptr;
-        mf.size = 0;
-        return true;
-    }
-    HANDLE map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
-    if (!map) {
-        CloseHandle(file);
-        return false;
-    }
-    void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
-    if (!view) {
-        CloseHandle(map);
-        CloseHandle(file);
-        return false;
-    }
-    mf.hFile = file;
-    mf.hMap = map;
-    mf.data = static_cast<const char*>(view);
-    mf.size = static_cast<size_t>(sz.QuadPart);
-    return true;
-#else
-    int fd = ::open(path.c_str(), O_RDONLY);
-    if (fd < 0) return false;
-    struct stat st{};
-    if (fstat(fd, &st) != 0) {
-        ::close(fd);
-        return false;
-    }
-    if (st.st_size == 0) {
-        mf.fd = fd;
-        mf.data = nullptr;
-        mf.size = 0;
-        return true;
-    }
-    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
-    if (view == MAP_FAILED) {
-        ::close(fd);
-        return false;
-    }
-    mf.fd = fd;
-    mf.data = static_cast<const char*>(view);
-    mf.size = static_cast<size_t>(st.st_size);
-    return true;
-#endif
-}
-
-// Reads and compacts BF source (keeps only +-<>[],.) using a memory-mapped file when possible.
-// Returns true on success; on error, 'err' is set and 'out' left unchanged.
-static bool readBfFileCompacted(const std::string& filename, std::string& out, std::string& err) {
-    MappedFile mf;
-    if (mapFileReadOnly(filename, mf)) {
-        const char* p = mf.data;
-        const size_t n = mf.size;
-        if (n == 0 || p == nullptr) {
-            out.clear();
-            return true;
-        }
-        out.clear();
-        out.reserve(n);
-        // Single pass: append valid Brainfuck ops
-        for (size_t i = 0; i < n; ++i) {
-            if (isBfChar(p[i])) out.push_back(p[i]);
-        }
-        mf.close();
-        return true;
-    }
-    // Fallback: stream and compact
-    std::ifstream in(filename, std::ios::binary);
-    if (!in.is_open()) {
-        err = "File could not be opened";
-        return false;
-    }
-    std::string compact;
-    compact.reserve(1 << 16);
-    char c;
-    while (in.get(c)) {
-        if (isBfChar(c)) compact.push_back(c);
-    }
-    if (!in.eof() && in.fail()) {
-        err = "Error while reading file";
-        return false;
-    }
-    out.swap(compact);
-    return true;
-}
-
 struct CmdArgs {
     std::string filename;
     std::string evalCode;
+    std::string servePath;
+    std::string inputsDir;
+    std::string outDir;
+    std::string idiomsPath;
     bool dumpMemory = false;
     bool help = false;
     bool optimize = true;
     bool dynamicTape = false;
     bool profile = false;
+    bool optReport = false;
+    bool optReportJson = false;
     int eof = 0;
     std::size_t tapeSize = 30000;
     int cellWidth = 8;
     goof2::MemoryModel model = goof2::MemoryModel::Auto;
+    goof2::FlushPolicy flush = goof2::FlushPolicy::Auto;
+    goof2::OptLevel optLevel = goof2::OptLevel::O3;
+    std::uint64_t evalSteps = std::uint64_t(1) << 20;
 };
 
 CmdArgs parseArgs(int argc, char* argv[]) {
@@ -233,6 +66,21 @@ CmdArgs parseArgs(int argc, char* argv[]) {
             args.help = true;
         } else if (arg == "-nopt") {
             args.optimize = false;
+        } else if (arg.starts_with("-O")) {
+            if (!parseOptLevel(arg.substr(2), args.optLevel)) {
+                std::cerr << "Unknown optimization level: " << arg << std::endl;
+                args.help = true;
+            }
+        } else if (arg == "--eval-steps" && i + 1 < argc) {
+            const char* val = argv[++i];
+            char* end = nullptr;
+            unsigned long long parsed = std::strtoull(val, &end, 10);
+            if (val[0] == '-' || end == val || *end != '\0') {
+                std::cerr << "Step budget must be a non-negative integer: " << val << std::endl;
+                args.help = true;
+            } else {
+                args.evalSteps = static_cast<std::uint64_t>(parsed);
+            }
         } else if (arg == "-dts") {
             args.dynamicTape = true;
         } else if (arg == "-eof" && i + 1 < argc) {
@@ -267,6 +115,29 @@ CmdArgs parseArgs(int argc, char* argv[]) {
             }
         } else if (arg == "--profile") {
             args.profile = true;
+        } else if (arg == "--opt-report") {
+            args.optReport = true;
+            if (i + 1 < argc) {
+                const std::string_view format = argv[i + 1];
+                if (format == "json" || format == "text") {
+                    args.optReportJson = format == "json";
+                    ++i;
+                }
+            }
+        } else if (arg == "--idioms" && i + 1 < argc) {
+            args.idiomsPath = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            args.servePath = argv[++i];
+        } else if (arg == "--inputs" && i + 1 < argc) {
+            args.inputsDir = argv[++i];
+        } else if (arg == "--out-dir" && i + 1 < argc) {
+            args.outDir = argv[++i];
+        } else if (arg == "--flush" && i + 1 < argc) {
+            const char* val = argv[++i];
+            if (!parseFlushPolicy(val, args.flush)) {
+                std::cerr << "Unknown flush mode: " << val << std::endl;
+                args.help = true;
+            }
         } else if (arg == "-mm" && i + 1 < argc) {
             std::string mm = argv[++i];
             std::transform(mm.begin(), mm.end(), mm.begin(),
@@ -287,6 +158,16 @@ CmdArgs parseArgs(int argc, char* argv[]) {
     }
     return args;
 }
+
+// Loads the idiom file named on the command line, if any, reporting why it could not be.
+bool loadIdiomFile(const CmdArgs& args) {
+    if (args.idiomsPath.empty()) return true;
+    std::string err;
+    if (goof2::loadIdioms(args.idiomsPath, err)) return true;
+    std::cerr << "ERROR: " << args.idiomsPath << ": " << err << std::endl;
+    return false;
+}
+
 void printHelp(const char* prog) {
     std::cout << "Usage: " << prog << " [options]\n"
               << "Options:\n"
@@ -294,14 +175,168 @@ void printHelp(const char* prog) {
               << "  -i <file>        Execute code from file\n"
               << "  -dm              Dump memory after program\n"
               << "  -nopt            Disable optimizations\n"
+              << "  -O<level>        Optimization level (0, 1, 2, 3, auto; default 3)\n"
+              << "  --eval-steps <n> Instructions -O3 may run at compile time (0 = off)\n"
+              << "  --idioms <file>  Replace the loop shapes listed in <file> while compiling\n"
               << "  -dts             Enable dynamic tape resizing\n"
               << "  -eof <value>     Set EOF return value\n"
               << "  -ts <size>       Tape size in cells (default 30000)\n"
               << "  -cw <width>      Cell width in bits (8,16,32,64)\n"
               << "  --profile        Print execution profile\n"
+              << "  --opt-report [json]\n"
+              << "                   Print compile stage times and loops left unoptimized to\n"
+              << "                   stderr, as text or JSON\n"
               << "  -mm <model>      Memory model (auto, contiguous, fibonacci, paged, os)\n"
+              << "  --flush <mode>   Output flushing (auto, unbuffered, line, full, before-input,\n"
+              << "                   async)\n"
+              << "  --serve <socket> Serve requests on a Unix domain socket\n"
+              << "  --inputs <dir>   Run the program once per file in <dir> (needs --out-dir)\n"
+              << "  --out-dir <dir>  Directory for per-input output files\n"
               << "  -h               Show this help message" << std::endl;
 }
+
+template <typename CellT>
+int compileForReport(std::string code, const RunConfig& cfg, goof2::OptReport& report) {
+    goof2::InstructionCache cache;
+    return goof2::compile<CellT>(code, cache, cfg.optimize, cfg.eof, cfg.dynamicSize, false,
+                                 &report);
+}
+
+// Compiles source on its own and prints to stderr the time spent in each compile stage, the
+// idioms found and the innermost loops left as loops, at line:column, as text or JSON.
+void printOptReport(const std::string& source, const RunConfig& cfg, bool json) {
+    goof2::OptReport report;
+    int ret = 0;
+    switch (cfg.cellWidth) {
+        case 8:
+            ret = compileForReport<uint8_t>(source, cfg, report);
+            break;
+        case 16:
+            ret = compileForReport<uint16_t>(source, cfg, report);
+            break;
+        case 32:
+            ret = compileForReport<uint32_t>(source, cfg, report);
+            break;
+        case 64:
+            ret = compileForReport<uint64_t>(source, cfg, report);
+            break;
+        default:
+            return;
+    }
+    if (ret != 0) return;
+    const std::pair<const char*, double> stages[] = {
+        {"filter", report.filterSeconds},
+        {"balance", report.balanceSeconds},
+        {"idioms", report.idiomSeconds},
+        {"stream", report.streamSeconds},
+        {"divmod", report.divmodSeconds},
+        {"clear", report.clearSeconds},
+        {"scan", report.scanSeconds},
+        {"comma", report.commaSeconds},
+        {"copy", report.copySeconds},
+        {"rewrite", report.rewriteSeconds},
+        {"sets", report.setSeconds},
+        {"brackets", report.bracketSeconds},
+        {"emit", report.emitSeconds},
+        {"loop-cache", report.loopCacheSeconds},
+        {"tape", report.tapeSeconds},
+        {"eval", report.evalSeconds},
+    };
+    const std::pair<const char*, std::uint64_t> counts[] = {
+        {"clearLoops", report.clearLoops},
+        {"scanLoops", report.scanLoops},
+        {"copyLoops", report.copyLoops},
+        {"streamLoops", report.streamLoops},
+        {"divmodLoops", report.divmodLoops},
+        {"commaTrims", report.commaTrims},
+        {"sets", report.sets},
+        {"outputRuns", report.outputRuns},
+        {"loopCacheHits", report.loopCacheHits},
+        {"loopCacheMisses", report.loopCacheMisses},
+        {"loopsLeft", report.loopsLeft},
+        {"deadLoops", report.deadLoops},
+        {"evalSteps", report.evalSteps},
+    };
+    // Remarks come in source order, so one pass finds every line and column.
+    std::vector<std::pair<std::size_t, std::size_t>> positions;
+    std::size_t line = 1, column = 1, at = 0;
+    for (const goof2::OptRemark& remark : report.missed) {
+        for (; at < remark.offset && at < source.size(); ++at) {
+            if (source[at] == '\n') {
+                ++line;
+                column = 1;
+            } else {
+                ++column;
+            }
+        }
+        positions.emplace_back(line, column);
+    }
+    std::ostream& out = std::cerr;
+    if (json) {
+        out << "{\"stages\":{";
+        for (std::size_t i = 0; i < std::size(stages); ++i)
+            out << (i ? "," : "") << '"' << stages[i].first << "\":" << stages[i].second;
+        out << "},\"counts\":{";
+        for (std::size_t i = 0; i < std::size(counts); ++i)
+            out << (i ? "," : "") << '"' << counts[i].first << "\":" << counts[i].second;
+        out << "},\"idioms\":{";
+        for (std::size_t i = 0; i < report.idiomHits.size(); ++i)
+            out << (i ? "," : "") << '"' << report.idiomHits[i].first
+                << "\":" << report.idiomHits[i].second;
+        out << "},\"missed\":[";
+        for (std::size_t i = 0; i < report.missed.size(); ++i)
+            out << (i ? "," : "") << "{\"offset\":" << report.missed[i].offset
+                << ",\"line\":" << positions[i].first << ",\"column\":" << positions[i].second
+                << ",\"reason\":\"" << report.missed[i].reason << "\"}";
+        out << "]}" << std::endl;
+        return;
+    }
+    out << "Compile stages (ms):\n";
+    for (const auto& [name, seconds] : stages)
+        out << "  " << name << std::string(12 - std::string_view(name).size(), ' ')
+            << seconds * 1000.0 << '\n';
+    out << "Idioms: " << report.clearLoops << " clear, " << report.scanLoops << " scan, "
+        << report.copyLoops << " copy, " << report.streamLoops << " pass-through, "
+        << report.divmodLoops << " divmod, "
+        << report.commaTrims << " trimmed writes, " << report.sets << " sets, "
+        << report.outputRuns << " output runs\n"
+        << "Loop cache: " << report.loopCacheHits << " hits, " << report.loopCacheMisses
+        << " misses\n"
+        << "Loops left: " << report.loopsLeft << ", innermost: " << report.missed.size()
+        << ", dead: " << report.deadLoops << '\n'
+        << "Run at compile time: " << report.evalSteps << " instructions\n";
+    if (!report.idiomHits.empty()) {
+        out << "User idioms:";
+        for (std::size_t i = 0; i < report.idiomHits.size(); ++i)
+            out << (i ? ", " : " ") << report.idiomHits[i].second << ' '
+                << report.idiomHits[i].first;
+        out << '\n';
+    }
+    for (std::size_t i = 0; i < report.missed.size(); ++i)
+        out << "  " << positions[i].first << ':' << positions[i].second << ": "
+            << report.missed[i].reason << '\n';
+    out.flush();
+}
+
+int runBatchFromArgs(const CmdArgs& args, const RunConfig& cfg) {
+    if (args.outDir.empty()) {
+        std::cerr << "ERROR: --inputs requires --out-dir" << std::endl;
+        return 1;
+    }
+    std::string code = args.evalCode;
+    if (code.empty()) {
+        if (args.filename.empty()) {
+            std::cerr << "ERROR: --inputs requires a program (-i <file> or -e <code>)" << std::endl;
+            return 1;
+        }
+        std::string err;
+        if (!goof2::loadSource(args.filename, code, err)) {
+            std::cerr << "ERROR: " << err << std::endl;
+            return 1;
+        }
+    }
+    return runBatch(code, args.inputsDir, args.outDir, cfg);
+}
 }  // namespace
 
 #ifdef GOOF2_ENABLE_REPL
@@ -320,6 +355,9 @@ int main(int argc, char* argv[]) {
     }
 #endif
     CmdArgs opts = parseArgs(argc, argv);
+    goof2::setOptLevel(opts.optLevel);
+    goof2::setEvalBudget(opts.evalSteps);
+    if (!loadIdiomFile(opts)) return 1;
     std::string filename = opts.filename;
     std::string evalCode = opts.evalCode;
     const bool dumpMemoryFlag = opts.dumpMemory;
@@ -332,7 +370,8 @@ int main(int argc, char* argv[]) {
                    opts.model,
                    true,
                    false,
-                   0};
+                   0,
+                   opts.flush};
     const bool profile = opts.profile;
     if (cfg.tapeSize == 0) {
         std::cout << ansi::red << "ERROR:" << ansi::reset
@@ -355,38 +394,47 @@ int main(int argc, char* argv[]) {
         printHelp(argv[0]);
         return 0;
     }
+    const RunConfig runCfg{cfg.optimize, cfg.dynamicSize, cfg.eof, cfg.tapeSize,
+                           cfg.cellWidth, cfg.model, cfg.flush};
+    if (!opts.servePath.empty()) {
+        return runServer(opts.servePath, runCfg);
+    }
+    if (!opts.inputsDir.empty()) {
+        return runBatchFromArgs(opts, runCfg);
+    }
     if (cfg.cellWidth != 8) {
         std::cout << "Active cell width: " << cfg.cellWidth << " bits" << std::endl;
     }
     if (!evalCode.empty()) {
         size_t cellPtr = 0;
         std::string code = evalCode;
+        if (opts.optReport) printOptReport(code, runCfg, opts.optReportJson);
         switch (cfg.cellWidth) {
             case 8: {
                 std::vector<uint8_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint8_t>(cells, cellPtr, code, cfg.optimize, cfg.eof, cfg.dynamicSize,
-                                       cfg.model);
+                                       cfg.model, nullptr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint8_t>(cells, cellPtr);
                 break;
             }
             case 16: {
                 std::vector<uint16_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint16_t>(cells, cellPtr, code, cfg.optimize, cfg.eof,
-                                        cfg.dynamicSize, cfg.model);
+                                        cfg.dynamicSize, cfg.model, nullptr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint16_t>(cells, cellPtr);
                 break;
             }
             case 32: {
                 std::vector<uint32_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint32_t>(cells, cellPtr, code, cfg.optimize, cfg.eof,
-                                        cfg.dynamicSize, cfg.model);
+                                        cfg.dynamicSize, cfg.model, nullptr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint32_t>(cells, cellPtr);
                 break;
             }
             case 64: {
                 std::vector<uint64_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint64_t>(cells, cellPtr, code, cfg.optimize, cfg.eof,
-                                        cfg.dynamicSize, cfg.model);
+                                        cfg.dynamicSize, cfg.model, nullptr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint64_t>(cells, cellPtr);
                 break;
             }
@@ -402,39 +450,40 @@ int main(int argc, char* argv[]) {
         std::string code;
         {
             std::string err;
-            if (!readBfFileCompacted(filename, code, err)) {
+            if (!goof2::loadSource(filename, code, err)) {
                 std::cout << ansi::red << "ERROR:" << ansi::reset << ' ' << err << std::endl;
                 return 1;
             }
         }
+        if (opts.optReport) printOptReport(code, runCfg, opts.optReportJson);
         goof2::ProfileInfo profileInfo;
         goof2::ProfileInfo* profPtr = profile ? &profileInfo : nullptr;
         switch (cfg.cellWidth) {
             case 8: {
                 std::vector<uint8_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint8_t>(cells, cellPtr, code, cfg.optimize, cfg.eof, cfg.dynamicSize,
-                                       cfg.model, profPtr);
+                                       cfg.model, profPtr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint8_t>(cells, cellPtr);
                 break;
             }
             case 16: {
                 std::vector<uint16_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint16_t>(cells, cellPtr, code, cfg.optimize, cfg.eof,
-                                        cfg.dynamicSize, cfg.model, profPtr);
+                                        cfg.dynamicSize, cfg.model, profPtr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint16_t>(cells, cellPtr);
                 break;
             }
             case 32: {
                 std::vector<uint32_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint32_t>(cells, cellPtr, code, cfg.optimize, cfg.eof,
-                                        cfg.dynamicSize, cfg.model, profPtr);
+                                        cfg.dynamicSize, cfg.model, profPtr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint32_t>(cells, cellPtr);
                 break;
             }
             case 64: {
                 std::vector<uint64_t> cells(cfg.tapeSize, 0);
                 executeExcept<uint64_t>(cells, cellPtr, code, cfg.optimize, cfg.eof,
-                                        cfg.dynamicSize, cfg.model, profPtr);
+                                        cfg.dynamicSize, cfg.model, profPtr, false, cfg.flush);
                 if (dumpMemoryFlag) dumpMemory<uint64_t>(cells, cellPtr);
                 break;
             }
@@ -447,6 +496,9 @@ int main(int argc, char* argv[]) {
             std::cout << "Instructions executed: " << profileInfo.instructions << std::endl;
             std::cout << "Elapsed time: " << profileInfo.seconds << "s" << std::endl;
             std::cout << "Heap allocations: " << profileInfo.heapBytes << " bytes" << std::endl;
+            if (cfg.flush == goof2::FlushPolicy::Async)
+                std::cout << "Writer stall time: " << profileInfo.writerStallSeconds << "s"
+                          << std::endl;
         }
         return 0;
     }
@@ -509,9 +561,9 @@ void dumpMemory(const std::vector<CellT>& cells, size_t cellPtr) {
 template <typename CellT>
 void executeExcept(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, bool optimize,
                    int eof, bool dynamicSize, goof2::MemoryModel model,
-                   goof2::ProfileInfo* profile) {
+                   goof2::ProfileInfo* profile, goof2::FlushPolicy flush) {
     int ret = goof2::execute<CellT>(cells, cellPtr, code, optimize, eof, dynamicSize, false, model,
-                                    profile);
+                                    profile, nullptr, flush);
     switch (ret) {
         case 1:
             std::cerr << "ERROR: Unmatched close bracket\n";
@@ -525,6 +577,9 @@ void executeExcept(std::vector<CellT>& cells, size_t& cellPtr, std::string& code
 
 int main(int argc, char* argv[]) {
     CmdArgs opts = parseArgs(argc, argv);
+    goof2::setOptLevel(opts.optLevel);
+    goof2::setEvalBudget(opts.evalSteps);
+    if (!loadIdiomFile(opts)) return 1;
 
     std::string filename = opts.filename;
     std::string evalCode = opts.evalCode;
@@ -556,6 +611,13 @@ int main(int argc, char* argv[]) {
         printHelp(argv[0]);
         return 0;
     }
+    const RunConfig runCfg{optimize, dynamicSize, eof, tapeSize, cellWidth, model, opts.flush};
+    if (!opts.servePath.empty()) {
+        return runServer(opts.servePath, runCfg);
+    }
+    if (!opts.inputsDir.empty()) {
+        return runBatchFromArgs(opts, runCfg);
+    }
     if (filename.empty() && evalCode.empty()) {
         std::cout << "REPL disabled; use -i <file> or -e <code> to run a program" << std::endl;
         return 0;
@@ -569,39 +631,40 @@ int main(int argc, char* argv[]) {
         code = evalCode;
     } else {
         std::string err;
-        if (!readBfFileCompacted(filename, code, err)) {
+        if (!goof2::loadSource(filename, code, err)) {
             std::cerr << "ERROR: " << err;
             return 1;
         }
     }
+    if (opts.optReport) printOptReport(code, runCfg, opts.optReportJson);
     goof2::ProfileInfo prof;
     goof2::ProfileInfo* profPtr = profile ? &prof : nullptr;
     switch (cellWidth) {
         case 8: {
             std::vector<uint8_t> cells(tapeSize, 0);
             executeExcept<uint8_t>(cells, cellPtr, code, optimize, eof, dynamicSize, model,
-                                   profPtr);
+                                   profPtr, opts.flush);
             if (dumpMemoryFlag) dumpMemory<uint8_t>(cells, cellPtr);
             break;
         }
         case 16: {
             std::vector<uint16_t> cells(tapeSize, 0);
             executeExcept<uint16_t>(cells, cellPtr, code, optimize, eof, dynamicSize, model,
-                                    profPtr);
+                                    profPtr, opts.flush);
             if (dumpMemoryFlag) dumpMemory<uint16_t>(cells, cellPtr);
             break;
         }
         case 32: {
             std::vector<uint32_t> cells(tapeSize, 0);
             executeExcept<uint32_t>(cells, cellPtr, code, optimize, eof, dynamicSize, model,
-                                    profPtr);
+                                    profPtr, opts.flush);
             if (dumpMemoryFlag) dumpMemory<uint32_t>(cells, cellPtr);
             break;
         }
         case 64: {
             std::vector<uint64_t> cells(tapeSize, 0);
             executeExcept<uint64_t>(cells, cellPtr, code, optimize, eof, dynamicSize, model,
-                                    profPtr);
+                                    profPtr, opts.flush);
             if (dumpMemoryFlag) dumpMemory<uint64_t>(cells, cellPtr);
             break;
         }
@@ -613,6 +676,8 @@ int main(int argc, char* argv[]) {
         std::cout << "Instructions executed: " << prof.instructions << std::endl;
         std::cout << "Elapsed time: " << prof.seconds << "s" << std::endl;
         std::cout << "Heap allocations: " << prof.heapBytes << " bytes" << std::endl;
+        if (opts.flush == goof2::FlushPolicy::Async)
+            std::cout << "Writer stall time: " << prof.writerStallSeconds << "s" << std::endl;
     }
     return 0;
 }
@@ -0,0 +1,133 @@
+/*
+    Goof2 - An optimizing brainfuck VM
+    Batch mode: one compiled program over many input files
+    Published under the GNU AGPL-3.0-or-later license
+*/
+// SPDX-License-Identifier: AGPL-3.0-or-later
+#include "batch.hxx"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+template <typename CellT>
+bool runOne(const std::string& source, const fs::path& inPath, const fs::path& outPath,
+            const RunConfig& cfg, goof2::InstructionCache& cache) {
+    // The input is read a block at a time as the program asks for it, so a large file is never
+    // held in memory whole.
+    const int inFd = ::open(inPath.c_str(), O_RDONLY | O_CLOEXEC);
+    std::ofstream output(outPath, std::ios::binary | std::ios::trunc);
+    if (inFd < 0 || !output.is_open()) {
+        if (inFd >= 0) ::close(inFd);
+        std::cerr << "ERROR: " << inPath.string() << ": could not open input or output file"
+                  << std::endl;
+        return false;
+    }
+    goof2::FdSource in(inFd);
+    goof2::CallbackSink out([&output](const char* bytes, size_t size) {
+        return static_cast<bool>(output.write(bytes, static_cast<std::streamsize>(size)));
+    });
+    std::vector<CellT> cells(cfg.tapeSize, 0);
+    size_t cellPtr = 0;
+    std::string code = source;
+    int ret = goof2::execute<CellT>(cells, cellPtr, code, cfg.optimize, cfg.eof, cfg.dynamicSize,
+                                    false, cfg.model, nullptr, &cache, cfg.flush, &in, &out);
+    ::close(inFd);
+    if (ret != 0) {
+        std::cerr << "ERROR: " << inPath.string() << ": program stopped with an error"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template <typename CellT>
+int runAll(const std::string& source, const std::vector<fs::path>& inputs, const fs::path& outDir,
+           const RunConfig& cfg) {
+    goof2::InstructionCache cache;
+    {
+        std::string code = source;
+        const int ret =
+            goof2::compile<CellT>(code, cache, cfg.optimize, cfg.eof, cfg.dynamicSize, false);
+        switch (ret) {
+            case 1:
+                std::cerr << "ERROR: Unmatched close bracket" << std::endl;
+                return 1;
+            case 2:
+                std::cerr << "ERROR: Unmatched open bracket" << std::endl;
+                return 1;
+        }
+    }
+    auto work = [&](std::atomic<size_t>& next) {
+        bool ok = true;
+        for (size_t i = next.fetch_add(1); i < inputs.size(); i = next.fetch_add(1)) {
+            ok &= runOne<CellT>(source, inputs[i], outDir / inputs[i].filename(), cfg, cache);
+        }
+        return ok;
+    };
+    // Runs read and write their own files, so workers share the process and the warm cache.
+    std::atomic<size_t> next{0};
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    const size_t workers = std::min(cores, inputs.size());
+    std::vector<std::thread> threads;
+    std::atomic<bool> ok{true};
+    for (size_t w = 1; w < workers; ++w) {
+        threads.emplace_back([&] {
+            if (!work(next)) ok = false;
+        });
+    }
+    if (!work(next)) ok = false;
+    for (auto& t : threads) t.join();
+    return ok ? 0 : 1;
+}
+}  // namespace
+
+int runBatch(const std::string& code, const std::string& inputDir, const std::string& outDir,
+             const RunConfig& cfg) {
+    std::error_code ec;
+    std::vector<fs::path> inputs;
+    for (fs::directory_iterator it(inputDir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec)) inputs.push_back(it->path());
+    }
+    if (ec) {
+        std::cerr << "ERROR: Could not read input directory " << inputDir << ": " << ec.message()
+                  << std::endl;
+        return 1;
+    }
+    std::sort(inputs.begin(), inputs.end());
+    fs::create_directories(outDir, ec);
+    if (ec || !fs::is_directory(outDir)) {
+        std::cerr << "ERROR: Could not create output directory " << outDir << std::endl;
+        return 1;
+    }
+    if (fs::equivalent(inputDir, outDir, ec)) {
+        std::cerr << "ERROR: Output directory must differ from the input directory" << std::endl;
+        return 1;
+    }
+    switch (cfg.cellWidth) {
+        case 8:
+            return runAll<uint8_t>(code, inputs, outDir, cfg);
+        case 16:
+            return runAll<uint16_t>(code, inputs, outDir, cfg);
+        case 32:
+            return runAll<uint32_t>(code, inputs, outDir, cfg);
+        case 64:
+            return runAll<uint64_t>(code, inputs, outDir, cfg);
+        default:
+            std::cerr << "ERROR: Unsupported cell width; use 8,16,32,64" << std::endl;
+            return 1;
+    }
+}
@@ -6,6 +6,7 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 #ifdef GOOF2_ENABLE_REPL
 #include "repl.hxx"
+#include "runConfig.hxx"
 
 #include <linenoise.h>
 #include <simde/x86/avx2.h>
@@ -29,6 +30,8 @@ int runRepl(std::vector<CellT>& cells, size_t& cellPtr, ReplConfig& cfg) {
     linenoiseHistorySetMaxLen(historyLen);
     std::vector<CellT> prevCells;
     std::vector<size_t> changed;
+    // Lines entered again, or edited, reuse what was compiled for earlier lines.
+    goof2::CompileSession session;
     while (true) {
         char* line = linenoise("$ ");
         if (line == nullptr) {
@@ -54,6 +57,7 @@ int runRepl(std::vector<CellT>& cells, size_t& cellPtr, ReplConfig& cfg) {
                           << ":size N           resize tape to N cells\n"
                           << ":eof N            set EOF value\n"
                           << ":opt on|off       toggle optimization\n"
+                          << ":opt 0|1|2|3|auto set optimization level\n"
                           << ":dyn on|off       toggle dynamic tape\n"
                           << ":model auto|contig|fib|paged|os\n"
                           << ":highlight on|off highlight changed cells\n"
@@ -80,10 +84,15 @@ int runRepl(std::vector<CellT>& cells, size_t& cellPtr, ReplConfig& cfg) {
             } else if (cmd == "opt") {
                 std::string val;
                 iss >> val;
+                goof2::OptLevel level;
                 if (val == "on")
                     cfg.optimize = true;
                 else if (val == "off")
                     cfg.optimize = false;
+                else if (parseOptLevel(val, level)) {
+                    cfg.optimize = true;
+                    goof2::setOptLevel(level);
+                }
             } else if (cmd == "dyn") {
                 std::string val;
                 iss >> val;
@@ -144,7 +153,7 @@ int runRepl(std::vector<CellT>& cells, size_t& cellPtr, ReplConfig& cfg) {
         }
         if (cfg.highlightChanges) prevCells = cells;
         executeExcept(cells, cellPtr, input, cfg.optimize, cfg.eof, cfg.dynamicSize, cfg.model,
-                      nullptr, true);
+                      nullptr, true, cfg.flush, &session);
         if (cfg.highlightChanges) {
             changed.clear();
             size_t limit = std::min(prevCells.size(), cells.size());
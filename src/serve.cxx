@@ -0,0 +1,333 @@
+/*
+    Goof2 - An optimizing brainfuck VM
+    Unix domain socket server mode
+    Published under the GNU AGPL-3.0-or-later license
+*/
+// SPDX-License-Identifier: AGPL-3.0-or-later
+#include "serve.hxx"
+
+#include <iostream>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include "threadPool.hxx"
+
+namespace {
+// Most source and input bytes, together, that one request may send.
+constexpr size_t kMaxRequestBytes = size_t(16) << 20;
+// Seconds a client may keep a worker waiting on it before the connection is dropped.
+constexpr time_t kSocketTimeoutSeconds = 10;
+// Instructions a request may run before it is stopped.
+constexpr std::uint64_t kRequestInstructionLimit = std::uint64_t(1) << 32;
+
+volatile std::sig_atomic_t stopRequested = 0;
+void onStopSignal(int) { stopRequested = 1; }
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size) {
+        ssize_t n = ::send(fd, data, size, kSendFlags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Sends program output to the client each time the VM flushes it.
+class SocketSink final : public goof2::IoSink {
+   public:
+    explicit SocketSink(int fd) : fd(fd) {}
+    bool write(const char* data, size_t size) override { return sendAll(fd, data, size); }
+
+   private:
+    int fd;
+};
+
+// Buffered reader for the request header and payload.
+class RequestReader {
+   public:
+    explicit RequestReader(int fd) : fd(fd) {}
+
+    bool readLine(std::string& line, size_t maxLen) {
+        for (;;) {
+            auto nl = std::find(pending.begin(), pending.end(), '\n');
+            if (nl != pending.end()) {
+                line.assign(pending.begin(), nl);
+                pending.erase(pending.begin(), nl + 1);
+                return true;
+            }
+            if (pending.size() > maxLen || !fill()) return false;
+        }
+    }
+
+    // Grows out as the bytes arrive, so a header alone does not reserve what it declares.
+    bool readExact(std::string& out, size_t size) {
+        out.clear();
+        while (out.size() < size) {
+            if (pending.empty() && !fill()) return false;
+            const size_t take = std::min(size - out.size(), pending.size());
+            out.append(pending, 0, take);
+            pending.erase(0, take);
+        }
+        return true;
+    }
+
+   private:
+    bool fill() {
+        std::array<char, 4096> chunk{};
+        for (;;) {
+            ssize_t n = ::recv(fd, chunk.data(), chunk.size(), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            pending.append(chunk.data(), static_cast<size_t>(n));
+            return true;
+        }
+    }
+
+    int fd;
+    std::string pending;
+};
+
+bool parseSize(const std::string& tok, size_t& out) {
+    if (tok.empty() || !std::all_of(tok.begin(), tok.end(),
+                                    [](unsigned char c) { return std::isdigit(c) != 0; }))
+        return false;
+    errno = 0;
+    unsigned long long v = std::strtoull(tok.c_str(), nullptr, 10);
+    if (errno == ERANGE) return false;
+    out = static_cast<size_t>(v);
+    return true;
+}
+
+bool parseHeader(const std::string& line, size_t& codeLen, size_t& inputLen, RunConfig& cfg,
+                 std::string& err) {
+    std::istringstream iss(line);
+    std::string tok;
+    if (!(iss >> tok) || !parseSize(tok, codeLen) || !(iss >> tok) || !parseSize(tok, inputLen)) {
+        err = "Expected '<source bytes> <input bytes> [options]'";
+        return false;
+    }
+    if (codeLen > kMaxRequestBytes || inputLen > kMaxRequestBytes - codeLen) {
+        err = "Request payload too large";
+        return false;
+    }
+    while (iss >> tok) {
+        if (tok == "-nopt") {
+            cfg.optimize = false;
+        } else if (tok == "-dts") {
+            cfg.dynamicSize = true;
+        } else if (tok == "-eof" || tok == "-ts" || tok == "-cw") {
+            const std::string flag = tok;
+            size_t value = 0;
+            if (!(iss >> tok) || !parseSize(tok, value)) {
+                err = "Invalid value for " + flag;
+                return false;
+            }
+            if (flag == "-eof") {
+                if (value > 2) {
+                    err = "Invalid EOF mode: " + tok;
+                    return false;
+                }
+                cfg.eof = static_cast<int>(value);
+            } else if (flag == "-ts") {
+                if (value == 0) {
+                    err = "Tape size must be a positive integer: " + tok;
+                    return false;
+                }
+                cfg.tapeSize = value;
+            } else {
+                if (value != 8 && value != 16 && value != 32 && value != 64) {
+                    err = "Unsupported cell width; use 8,16,32,64";
+                    return false;
+                }
+                cfg.cellWidth = static_cast<int>(value);
+            }
+        } else if (tok == "--flush" && iss >> tok) {
+            if (!parseFlushPolicy(tok, cfg.flush)) {
+                err = "Unknown flush mode: " + tok;
+                return false;
+            }
+        } else if (tok == "-mm" && iss >> tok) {
+            std::transform(tok.begin(), tok.end(), tok.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (tok == "auto") {
+                cfg.model = goof2::MemoryModel::Auto;
+            } else if (tok == "contiguous") {
+                cfg.model = goof2::MemoryModel::Contiguous;
+            } else if (tok == "fibonacci") {
+                cfg.model = goof2::MemoryModel::Fibonacci;
+            } else if (tok == "paged") {
+                cfg.model = goof2::MemoryModel::Paged;
+            } else if (tok == "os") {
+                cfg.model = goof2::MemoryModel::OSBacked;
+            } else {
+                err = "Unknown memory model: " + tok;
+                return false;
+            }
+        } else {
+            err = "Unknown option: " + tok;
+            return false;
+        }
+    }
+    if (cfg.tapeSize > GOOF2_TAPE_MAX_BYTES / static_cast<size_t>(cfg.cellWidth / 8)) {
+        err = "Requested tape exceeds maximum allowed size";
+        return false;
+    }
+    return true;
+}
+
+template <typename CellT>
+int runRequest(std::string& code, const RunConfig& cfg, goof2::InstructionCache& cache,
+               goof2::ProfileInfo& profile, goof2::IoSource& in, goof2::IoSink& out) {
+    std::vector<CellT> cells(cfg.tapeSize, 0);
+    size_t cellPtr = 0;
+    // Keep streaming output to the client line by line unless the request asks otherwise.
+    const auto flush = cfg.flush == goof2::FlushPolicy::Auto ? goof2::FlushPolicy::Line : cfg.flush;
+    return goof2::execute<CellT>(cells, cellPtr, code, cfg.optimize, cfg.eof, cfg.dynamicSize,
+                                 false, cfg.model, &profile, &cache, flush, &in, &out);
+}
+
+void replyError(int fd, const std::string& msg) {
+    const std::string line = "ERROR: " + msg + "\n";
+    sendAll(fd, line.data(), line.size());
+}
+
+void handleClient(int fd, RunConfig cfg, goof2::InstructionCache& cache) {
+    const timeval timeout{kSocketTimeoutSeconds, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    RequestReader reader(fd);
+    std::string header, code, input, err;
+    size_t codeLen = 0, inputLen = 0;
+    if (!reader.readLine(header, 4096)) {
+        replyError(fd, "Missing request header");
+    } else if (!parseHeader(header, codeLen, inputLen, cfg, err)) {
+        replyError(fd, err);
+    } else if (!reader.readExact(code, codeLen) || !reader.readExact(input, inputLen)) {
+        replyError(fd, "Truncated request");
+    } else {
+        goof2::SpanSource in(input);
+        SocketSink out(fd);
+        goof2::ProfileInfo profile;
+        profile.instructionLimit = kRequestInstructionLimit;
+        int ret = 0;
+        switch (cfg.cellWidth) {
+            case 8:
+                ret = runRequest<uint8_t>(code, cfg, cache, profile, in, out);
+                break;
+            case 16:
+                ret = runRequest<uint16_t>(code, cfg, cache, profile, in, out);
+                break;
+            case 32:
+                ret = runRequest<uint32_t>(code, cfg, cache, profile, in, out);
+                break;
+            default:
+                ret = runRequest<uint64_t>(code, cfg, cache, profile, in, out);
+                break;
+        }
+        if (ret == 1) replyError(fd, "Unmatched close bracket");
+        if (ret == 2) replyError(fd, "Unmatched open bracket");
+        if (ret == -1)
+            replyError(fd, profile.instructions == kRequestInstructionLimit
+                               ? "Instruction limit reached"
+                               : "Program stopped with an error");
+    }
+    ::close(fd);
+}
+}  // namespace
+
+int runServer(const std::string& socketPath, const RunConfig& defaults) {
+    if (defaults.cellWidth != 8 && defaults.cellWidth != 16 && defaults.cellWidth != 32 &&
+        defaults.cellWidth != 64) {
+        std::cerr << "ERROR: Unsupported cell width; use 8,16,32,64" << std::endl;
+        return 1;
+    }
+    sockaddr_un addr{};
+    if (socketPath.empty() || socketPath.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "ERROR: Socket path is empty or too long" << std::endl;
+        return 1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    // Replace a stale socket from an earlier run, but never a regular file.
+    struct stat st{};
+    if (lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        ::unlink(socketPath.c_str());
+    }
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listenFd, SOMAXCONN) != 0) {
+        std::cerr << "ERROR: Could not listen on " << socketPath << ": " << std::strerror(errno)
+                  << std::endl;
+        if (listenFd >= 0) ::close(listenFd);
+        return 1;
+    }
+
+    struct sigaction sa{};
+    sa.sa_handler = onStopSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESETHAND;  // no SA_RESTART: accept() must return on a stop request
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // Keep stop signals on the accepting thread; workers inherit the blocked mask.
+    sigset_t stopSignals, oldMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &oldMask);
+
+    goof2::InstructionCache cache;
+    {
+        goof2::ThreadPool pool;
+        pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+        // Status goes to stderr so stdout stays free for anything a caller pipes through.
+        std::cerr << "Serving on " << socketPath << std::endl;
+        while (!stopRequested) {
+            int client = ::accept(listenFd, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                std::cerr << "ERROR: accept failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            pool.submit([client, defaults, &cache]() { handleClient(client, defaults, cache); });
+        }
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+    }
+    return 0;
+}
+#else
+int runServer(const std::string&, const RunConfig&) {
+    std::cerr << "ERROR: --serve requires Unix domain sockets" << std::endl;
+    return 1;
+}
+#endif
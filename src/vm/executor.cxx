@@ -12,6 +12,7 @@
 #endif
 
 #include "vm.hxx"
+#include "vm/io.hxx"
 #include "vm/memory.hxx"
 #include "vm/optimizer.hxx"
 
@@ -21,6 +22,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
 #include <chrono>
 #include <cmath>
@@ -28,6 +30,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <functional>
 #include <future>
 #include <iostream>
@@ -36,8 +39,10 @@
 #include <mutex>
 #include <ranges>
 #include <regex>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <utility>
@@ -55,19 +60,27 @@
 namespace {
 constexpr std::size_t kCacheExpectedEntries = 64;
 constexpr std::size_t kCacheMaxEntries = 64;
+// Sources at least twice this size are compiled in slices of about this many bytes.
+std::atomic<std::size_t> sliceSize{std::size_t(1) << 18};
+// A CompileSession cuts every source into slices of about this many bytes, so an edit only
+// recompiles the loops near it, and drops its slices once it holds this many.
+constexpr std::size_t kSessionSliceSize = 1024;
+constexpr std::size_t kSessionMaxSlices = std::size_t(1) << 14;
+std::atomic<goof2::OptLevel> optLevel{goof2::OptLevel::O3};
+// How many instructions the compiler may run of a program's input-free start; 0 turns it off.
+std::atomic<std::uint64_t> evalBudget{std::uint64_t(1) << 20};
+// Loop idioms loaded with loadIdioms(), and a hash of their file that keeps what was compiled with
+// other idioms apart in the caches.
+std::mutex idiomMutex;
+std::shared_ptr<const std::vector<goof2::Idiom>> userIdioms;
+std::atomic<std::uint64_t> idiomsKey{0};
+// Compile-time runs give up on programs that reach this far along the tape.
+constexpr ptrdiff_t kEvalCells = ptrdiff_t(1) << 20;
 std::list<size_t> cacheUsage;
 std::mutex cacheMutex;
 }  // namespace
 
-inline int32_t fold(std::string_view code, size_t& i, char match) {
-    int32_t count = 1;
-    while (i < code.length() - 1 && code[i + 1] == match) {
-        ++i;
-        ++count;
-    }
-    return count;
-}
-
+using goof2::FlushPolicy;
 using goof2::MemoryModel;
 
 #if defined(SIMDE_ARCH_AARCH64)
@@ -90,6 +103,319 @@ static inline unsigned lzcnt64(unsigned long long x) {
     return static_cast<unsigned>(std::countl_zero(x));
 }
 
+// Bit j is set when byte j of the 32 at p equals c.
+static inline uint32_t byteMask(const char* p, char c) {
+    const simde__m256i v = simde_mm256_loadu_si256(reinterpret_cast<const simde__m256i*>(p));
+    return static_cast<uint32_t>(
+        simde_mm256_movemask_epi8(simde_mm256_cmpeq_epi8(v, simde_mm256_set1_epi8(c))));
+}
+
+// Length of the run of match starting at code[i]; leaves i on the run's last character.
+inline int32_t fold(std::string_view code, size_t& i, char match) {
+    size_t j = i + 1;
+    for (; j + 32 <= code.size(); j += 32) {
+        const uint32_t same = byteMask(code.data() + j, match);
+        if (same != 0xFFFFFFFFu) {
+            j += tzcnt32(~same);
+            const int32_t count = static_cast<int32_t>(j - i);
+            i = j - 1;
+            return count;
+        }
+    }
+    while (j < code.size() && code[j] == match) ++j;
+    const int32_t count = static_cast<int32_t>(j - i);
+    i = j - 1;
+    return count;
+}
+
+namespace {
+// Bracket positions in source order; partner[k] is the index of the bracket matching the k-th.
+struct BracketPairs {
+    std::pmr::vector<size_t> pos;
+    std::pmr::vector<uint32_t> partner;
+    explicit BracketPairs(std::pmr::memory_resource* mr) : pos(mr), partner(mr) {}
+};
+
+// Finds the brackets 32 bytes at a time and pairs them with a stack of bracket indices. Returns
+// 1 for an unmatched ']' and 2 for an unmatched '['.
+int matchBrackets(std::string_view code, BracketPairs& out, std::pmr::memory_resource* mr) {
+    const char* src = code.data();
+    size_t i = 0;
+    for (; i + 32 <= code.size(); i += 32) {
+        uint32_t mask = byteMask(src + i, '[') | byteMask(src + i, ']');
+        while (mask) {
+            out.pos.push_back(i + tzcnt32(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < code.size(); ++i)
+        if (src[i] == '[' || src[i] == ']') out.pos.push_back(i);
+
+    out.partner.resize(out.pos.size());
+    std::pmr::vector<uint32_t> stack(mr);
+    for (uint32_t k = 0; k < out.pos.size(); ++k) {
+        if (src[out.pos[k]] == '[') {
+            stack.push_back(k);
+        } else {
+            if (stack.empty()) return 1;
+            out.partner[k] = stack.back();
+            out.partner[stack.back()] = k;
+            stack.pop_back();
+        }
+    }
+    return stack.empty() ? 0 : 2;
+}
+
+// The cells a loop's body reaches, relative to the cell it tests, and whether every iteration
+// ends back on that cell.
+struct LoopExtent {
+    ptrdiff_t low = 0;
+    ptrdiff_t high = 0;
+    bool balanced = false;
+};
+
+// Measures every loop in code, at the index of its '[' in brackets.pos. A loop that holds a scan
+// or a loop that is not balanced is not balanced either.
+void measureLoops(std::string_view code, std::pmr::vector<LoopExtent>& out,
+                  std::pmr::memory_resource* mr) {
+    struct Open {
+        size_t index;
+        ptrdiff_t start, low, high;
+        bool balanced;
+    };
+    std::pmr::vector<Open> open(mr);
+    ptrdiff_t pos = 0;
+    size_t next = 0;
+    for (const char c : code) {
+        switch (c) {
+            case '>':
+                ++pos;
+                if (!open.empty()) open.back().high = std::max(open.back().high, pos);
+                break;
+            case '<':
+                --pos;
+                if (!open.empty()) open.back().low = std::min(open.back().low, pos);
+                break;
+            case 'R':
+            case 'L':
+                if (!open.empty()) open.back().balanced = false;
+                break;
+            case '[':
+                open.push_back(Open{next++, pos, pos, pos, true});
+                break;
+            case ']': {
+                const Open loop = open.back();
+                open.pop_back();
+                ++next;
+                const bool balanced = loop.balanced && pos == loop.start;
+                out[loop.index] =
+                    LoopExtent{loop.low - loop.start, loop.high - loop.start, balanced};
+                if (!open.empty()) {
+                    Open& outer = open.back();
+                    outer.balanced = outer.balanced && balanced;
+                    outer.low = std::min(outer.low, loop.low);
+                    outer.high = std::max(outer.high, loop.high);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+// What a loop does when its body only adds to, clears and sets cells at fixed offsets and leaves
+// the pointer where it was. For every cell but the one it tests, the value the loop leaves in it,
+// or for a cell it adds to, the factor that times the tested cell gives the sum of all additions.
+struct AffineLoop {
+    struct Cell {
+        ptrdiff_t offset;
+        int64_t value;
+        bool set;
+    };
+    std::vector<Cell> cells;
+};
+
+// Reads body, the optimized text between the brackets of an innermost loop, into loop. The loop
+// runs until the cell it tests, stepped by the same amount each time, wraps around to zero. For
+// an odd step the trip count is the cell times minus the inverse of the step modulo the cell
+// width. Returns true when the step is odd and every cell and factor fits one instruction.
+template <typename CellT>
+bool affineLoop(std::string_view body, AffineLoop& loop) {
+    loop.cells.clear();
+    ptrdiff_t pos = 0;
+    auto cellAt = [&loop](ptrdiff_t at) -> AffineLoop::Cell& {
+        for (AffineLoop::Cell& cell : loop.cells)
+            if (cell.offset == at) return cell;
+        return loop.cells.emplace_back(AffineLoop::Cell{at, 0, false});
+    };
+    for (const char c : body) {
+        switch (c) {
+            case '>':
+                ++pos;
+                break;
+            case '<':
+                --pos;
+                break;
+            case '+':
+            case '-':
+                cellAt(pos).value += c == '+' ? 1 : -1;
+                break;
+            case 'C':
+            case 'S':  // the run after S is added to the zero it leaves
+                cellAt(pos) = AffineLoop::Cell{pos, 0, true};
+                break;
+            default:
+                return false;
+        }
+        if (pos < INT16_MIN || pos > INT16_MAX) return false;
+    }
+    if (pos != 0) return false;
+    const auto counter = std::ranges::find(loop.cells, ptrdiff_t(0), &AffineLoop::Cell::offset);
+    if (counter == loop.cells.end() || counter->set) return false;
+    const uint64_t step = static_cast<uint64_t>(counter->value);
+    if (!(step & 1)) return false;
+    // Each round of Newton's iteration doubles the low bits that are right, starting from three.
+    uint64_t inverse = step;
+    for (int k = 0; k < 5; ++k) inverse *= 2 - step * inverse;
+    loop.cells.erase(counter);
+    std::erase_if(loop.cells,
+                  [](const AffineLoop::Cell& cell) { return !cell.set && !cell.value; });
+    for (AffineLoop::Cell& cell : loop.cells) {
+        if (cell.set) {
+            if (cell.value < INT32_MIN || cell.value > INT32_MAX) return false;
+            continue;
+        }
+        cell.value = static_cast<std::make_signed_t<CellT>>(
+            static_cast<CellT>(0 - static_cast<uint64_t>(cell.value) * inverse));
+        if (cell.value < INT16_MIN || cell.value > INT16_MAX) return false;
+    }
+    std::ranges::sort(loop.cells, {}, &AffineLoop::Cell::offset);
+    return true;
+}
+
+// The additions a balanced loop makes after its first pass when each pass adds the same amount
+// to a cell: the tested cell times factor, times the cell at source unless source is the tested
+// cell. Offsets are relative to the tested cell.
+struct NestedLoop {
+    struct Term {
+        int16_t target;
+        int16_t source;
+        int16_t factor;
+    };
+    std::vector<Term> terms;
+};
+
+// Reads the compiled body [begin, end) of a loop testing the cell at offset at into loop. The
+// body may only add, set, clear and multiply-add cells, so one pass is an affine map of the
+// tape. Cells the map sets to a constant hold it after the first pass; with those known, every
+// later pass must step the tested cell by the same odd amount and add to the other cells only
+// amounts made of cells no pass changes. Then the passes after the first add the same amounts
+// each time, as many times as the trip count left. Returns false for any other loop, and for
+// factors or offsets one instruction cannot hold.
+template <typename CellT>
+bool nestedLoop(const instruction* begin, const instruction* end, int16_t at, NestedLoop& loop) {
+    loop.terms.clear();
+    std::vector<ptrdiff_t> cells{at};
+    auto index = [&cells](ptrdiff_t cell) {
+        const auto it = std::ranges::find(cells, cell);
+        if (it != cells.end()) return static_cast<size_t>(it - cells.begin());
+        cells.push_back(cell);
+        return cells.size() - 1;
+    };
+    constexpr size_t maxCells = 32;
+    for (const instruction* inst = begin; inst != end; ++inst) {
+        switch (inst->op) {
+            case insType::ADD_SUB:
+            case insType::SET:
+            case insType::CLR:
+                index(inst->offset);
+                break;
+            case insType::CLR_RNG:
+                if (inst->data > static_cast<int32_t>(maxCells)) return false;
+                for (int32_t k = 0; k < inst->data; ++k) index(inst->offset + k);
+                break;
+            case insType::MUL_CPY:
+                index(inst->offset);
+                index(inst->offset + inst->data);
+                break;
+            default:
+                return false;
+        }
+        if (cells.size() > maxCells) return false;
+    }
+    // Row i holds the coefficients of every cell, then a constant, that give cell i after a pass.
+    const size_t n = cells.size();
+    std::vector<std::vector<uint64_t>> rows(n, std::vector<uint64_t>(n + 1, 0));
+    for (size_t i = 0; i < n; ++i) rows[i][i] = 1;
+    for (const instruction* inst = begin; inst != end; ++inst) {
+        std::vector<uint64_t>& row = rows[index(inst->offset)];
+        switch (inst->op) {
+            case insType::ADD_SUB:
+                row[n] += static_cast<uint64_t>(static_cast<int64_t>(inst->data));
+                break;
+            case insType::SET:
+            case insType::CLR:
+                std::ranges::fill(row, 0);
+                row[n] = inst->op == insType::SET ? static_cast<uint64_t>(inst->data) : 0;
+                break;
+            case insType::CLR_RNG:
+                for (int32_t k = 0; k < inst->data; ++k)
+                    std::ranges::fill(rows[index(inst->offset + k)], 0);
+                break;
+            default: {
+                const std::vector<uint64_t> source = row;
+                std::vector<uint64_t>& target = rows[index(inst->offset + inst->data)];
+                const uint64_t factor = static_cast<uint64_t>(static_cast<int64_t>(inst->auxData));
+                for (size_t j = 0; j <= n; ++j) target[j] += factor * source[j];
+                break;
+            }
+        }
+    }
+    auto zero = [](uint64_t value) { return static_cast<CellT>(value) == 0; };
+    std::vector<bool> known(n);
+    for (size_t i = 0; i < n; ++i)
+        known[i] = std::all_of(rows[i].begin(), rows[i].begin() + n, zero);
+    // What a pass after the first adds to each cell, with the known cells put in.
+    std::vector<std::vector<uint64_t>> steps = rows;
+    for (size_t i = 0; i < n; ++i) {
+        steps[i][i] -= 1;
+        for (size_t j = 0; j < n; ++j) {
+            if (!known[j]) continue;
+            steps[i][n] += steps[i][j] * rows[j][n];
+            steps[i][j] = 0;
+        }
+    }
+    auto still = [&](size_t i) { return std::ranges::all_of(steps[i], zero); };
+    const uint64_t step = steps[0][n];
+    if (!std::all_of(steps[0].begin(), steps[0].begin() + n, zero) ||
+        !(static_cast<CellT>(step) & 1))
+        return false;
+    uint64_t inverse = step;
+    for (int k = 0; k < 5; ++k) inverse *= 2 - step * inverse;
+    auto fits = [](ptrdiff_t value) { return value >= INT16_MIN && value <= INT16_MAX; };
+    auto add = [&](size_t target, size_t source, uint64_t coefficient) {
+        const int64_t factor = static_cast<std::make_signed_t<CellT>>(
+            static_cast<CellT>(0 - coefficient * inverse));
+        const ptrdiff_t to = cells[target] - at, from = cells[source] - at;
+        if (!fits(factor) || !fits(to) || !fits(from)) return false;
+        loop.terms.push_back(NestedLoop::Term{static_cast<int16_t>(to),
+                                              static_cast<int16_t>(from),
+                                              static_cast<int16_t>(factor)});
+        return true;
+    };
+    for (size_t i = 1; i < n; ++i) {
+        if (still(i)) continue;
+        for (size_t j = 0; j < n; ++j) {
+            if (zero(steps[i][j])) continue;
+            if (j == 0 || !still(j) || !add(i, j, steps[i][j])) return false;
+        }
+        if (!zero(steps[i][n]) && !add(i, 0, steps[i][n])) return false;
+    }
+    return true;
+}
+}  // namespace
+
 static inline bool runtimeHasAvx512() {
 #if defined(SIMDE_ARCH_X86) && !defined(__EMSCRIPTEN__)
     static int cached = -1;
@@ -489,7 +815,7 @@ static inline size_t simdScan0BackSse2(const CellT* base, const CellT* p) {
             int m = simde_mm_movemask_epi8(cmp);
             m = compressMask16<Bytes>(m);
             if (m) {
-                unsigned bit = 15u - lzcnt32((unsigned)m);
+                unsigned bit = 31u - lzcnt32((unsigned)m);
                 unsigned lane = bit / Bytes;
                 return (size_t)(p - (blk + lane));
             }
@@ -623,7 +949,7 @@ static inline size_t simdScan0BackNeon(const CellT* base, const CellT* p) {
             int m = simde_mm_movemask_epi8(cmp);
             m = compressMask16<Bytes>(m);
             if (m) {
-                unsigned bit = 15u - lzcnt32((unsigned)m);
+                unsigned bit = 31u - lzcnt32((unsigned)m);
                 unsigned lane = bit / Bytes;
                 return (size_t)(p - (blk + lane));
             }
@@ -856,7 +1182,7 @@ static inline size_t simdScan0BackStride(const CellT* base, const CellT* p, unsi
             m = compressMask16<Bytes>(m);
             m &= (int)StrideMask16Table<Bytes, Step>::masks[lane0];
             if (m) {
-                unsigned bit = 15u - lzcnt32((unsigned)m);
+                unsigned bit = 31u - lzcnt32((unsigned)m);
                 unsigned lane = bit / Bytes;
                 return (size_t)(p - (blk + lane));
             }
@@ -1104,6 +1430,8 @@ constexpr std::array<insType, 256> charToOpcode = [] {
     table[static_cast<unsigned char>('P')] = insType::MUL_CPY;
     table[static_cast<unsigned char>('R')] = insType::SCN_RGT;
     table[static_cast<unsigned char>('L')] = insType::SCN_LFT;
+    table[static_cast<unsigned char>('K')] = insType::STREAM_COPY;
+    table[static_cast<unsigned char>('D')] = insType::DIVMOD;
     return table;
 }();
 
@@ -1111,330 +1439,571 @@ namespace {
 thread_local std::vector<int> copyloopMap;
 thread_local std::vector<int> scanloopMap;
 thread_local std::vector<uint8_t> scanloopClrMap;
-}  // namespace
 
-template <typename CellT, bool Dynamic, bool Term, bool Sparse>
-int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, bool optimize,
-                int eof, MemoryModel model, bool adaptive, size_t span, goof2::ProfileInfo* profile,
-                std::vector<instruction>* cached) {
+template <typename F>
+struct ScopeExit {
+    F fn;
+    ~ScopeExit() { fn(); }
+};
+template <typename F>
+ScopeExit(F) -> ScopeExit<F>;
+
+// Where one run's input and output go; null source or sink means the standard streams.
+struct IoConfig {
+    FlushPolicy flush;
+    goof2::IoSource* input;
+    goof2::IoSink* output;
+};
+
+// Pointer movement and allocation totals for one compiled slice of the source.
+struct ChunkStats {
+    ptrdiff_t endPos = 0;
+    ptrdiff_t minPos = 0;
+    ptrdiff_t maxPos = 0;
+    size_t heapBytes = 0;
+};
+
+// Adds the time since it last ran to one of report's stage times; does nothing without a report.
+struct StageTimer {
+    goof2::OptReport* report;
+    std::chrono::steady_clock::time_point last =
+        report ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+    void operator()(double goof2::OptReport::*stage) {
+        if (!report) return;
+        const auto now = std::chrono::steady_clock::now();
+        if (stage) report->*stage += std::chrono::duration<double>(now - last).count();
+        last = now;
+    }
+};
+
+// Adds a slice's report to the whole source's, with its loops moved to the slice's offset.
+void addReport(goof2::OptReport& into, const goof2::OptReport& from, size_t offset) {
+    into.filterSeconds += from.filterSeconds;
+    into.balanceSeconds += from.balanceSeconds;
+    into.idiomSeconds += from.idiomSeconds;
+    into.streamSeconds += from.streamSeconds;
+    into.divmodSeconds += from.divmodSeconds;
+    into.clearSeconds += from.clearSeconds;
+    into.scanSeconds += from.scanSeconds;
+    into.commaSeconds += from.commaSeconds;
+    into.copySeconds += from.copySeconds;
+    into.rewriteSeconds += from.rewriteSeconds;
+    into.setSeconds += from.setSeconds;
+    into.bracketSeconds += from.bracketSeconds;
+    into.emitSeconds += from.emitSeconds;
+    into.loopCacheSeconds += from.loopCacheSeconds;
+    into.clearLoops += from.clearLoops;
+    into.scanLoops += from.scanLoops;
+    into.copyLoops += from.copyLoops;
+    into.streamLoops += from.streamLoops;
+    into.divmodLoops += from.divmodLoops;
+    into.commaTrims += from.commaTrims;
+    into.sets += from.sets;
+    into.loopCacheHits += from.loopCacheHits;
+    into.loopCacheMisses += from.loopCacheMisses;
+    into.loopsLeft += from.loopsLeft;
+    if (into.idiomHits.empty())
+        into.idiomHits = from.idiomHits;
+    else
+        for (size_t k = 0; k < from.idiomHits.size() && k < into.idiomHits.size(); ++k)
+            into.idiomHits[k].second += from.idiomHits[k].second;
+    for (const goof2::OptRemark& remark : from.missed)
+        into.missed.push_back(goof2::OptRemark{remark.offset + offset, remark.reason});
+}
+
+// Keeps the entries of loops, the source offsets of the '[' in code in order, whose '[' is outside
+// every removed range. The ranges are sorted, disjoint and each covers whole loops.
+void dropLoops(std::string_view code, const std::vector<std::pair<size_t, size_t>>& removed,
+               std::vector<size_t>& loops) {
+    size_t kept = 0, k = 0, r = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i] != '[') continue;
+        while (r < removed.size() && removed[r].second <= i) ++r;
+        if (r == removed.size() || i < removed[r].first) loops[kept++] = loops[k];
+        ++k;
+    }
+    loops.resize(kept);
+}
+
+// Like dropLoops, for ranges replaced by text that holds count loops: the loops of each range
+// give way to count entries for its first loop.
+void replaceLoops(std::string_view code,
+                  const std::vector<std::tuple<size_t, size_t, size_t>>& replaced,
+                  std::vector<size_t>& loops) {
+    std::vector<size_t> kept;
+    size_t k = 0, r = 0;
+    for (size_t i = 0; i < code.size() && k < loops.size(); ++i) {
+        if (code[i] != '[') continue;
+        while (r < replaced.size() && std::get<1>(replaced[r]) <= i) ++r;
+        if (r == replaced.size() || i < std::get<0>(replaced[r]))
+            kept.push_back(loops[k]);
+        else if (i == std::get<0>(replaced[r]))
+            kept.insert(kept.end(), std::get<2>(replaced[r]), loops[k]);
+        ++k;
+    }
+    loops = std::move(kept);
+}
+
+// Why an innermost loop with this optimized body, the text between its brackets, was left as a
+// loop.
+std::string missedReason(std::string_view body, goof2::OptLevel level) {
+    if (body.find_first_of(".,K") != std::string_view::npos) return "does input or output";
+    if (level < goof2::OptLevel::O1) return "optimizations are off";
+    if (body.find_first_of(level < goof2::OptLevel::O2 ? "CSPRL" : "PRL") !=
+        std::string_view::npos)
+        return "holds a clear, set, scan or copy";
+    ptrdiff_t pos = 0, counter = 0;
+    bool setsCounter = false;
+    for (char c : body) {
+        if (c == '>')
+            ++pos;
+        else if (c == '<')
+            --pos;
+        else if (c == 'C' || c == 'S')
+            setsCounter |= pos == 0;
+        else if (pos == 0)
+            counter += c == '+' ? 1 : -1;
+    }
+    if (pos != 0) return "moves the pointer by " + std::to_string(pos) + " per iteration";
+    if (setsCounter) return "sets the cell it tests";
+    if (counter == 0) return "never changes the cell it tests";
+    if (counter % 2 == 0)
+        return "changes the cell it tests by " + std::to_string(counter) + " per iteration";
+    if (level < goof2::OptLevel::O2) return "copy and multiply loops need -O2";
+    return "needs a factor wider than one instruction holds";
+}
+
+// Optimizes code in place and appends its instructions, leaving the pointer movement flushed and
+// jump targets unresolved. The regex passes run on pool when one is given. With a report, the
+// stage times, idiom counts and loops left, at offsets in the code as given, are added to it.
+template <typename CellT, bool Term>
+int compileChunk(std::string& code, goof2::OptLevel level, int eof, goof2::ThreadPool* pool,
+                 std::vector<instruction>& instructions, ChunkStats& stats,
+                 goof2::OptReport* report) {
+    StageTimer timer{report};
+    // Source offsets of the '[' still in code, kept for the report as passes remove loops.
+    std::vector<size_t> loopOffsets;
+    if (report)
+        for (size_t i = 0; i < code.size(); ++i)
+            if (code[i] == '[') loopOffsets.push_back(i);
+    uint64_t foldedClears = 0, foldedCopies = 0, trimmedCommas = 0, divmods = 0;
     constexpr std::size_t bufSize = 64 * 1024;
-    std::array<std::byte, bufSize> mainBuf{};
+    std::array<std::byte, bufSize> mainBuf;
     goof2::CountingResource mainCount;
     std::pmr::monotonic_buffer_resource mainMr(mainBuf.data(), mainBuf.size(), &mainCount);
 
-    std::array<std::byte, bufSize> clearBuf{};
+    std::array<std::byte, bufSize> clearBuf;
     goof2::CountingResource clearCount;
     std::pmr::monotonic_buffer_resource clearMr(clearBuf.data(), clearBuf.size(), &clearCount);
 
-    std::array<std::byte, bufSize> scanBuf{};
+    std::array<std::byte, bufSize> scanBuf;
     goof2::CountingResource scanCount;
     std::pmr::monotonic_buffer_resource scanMr(scanBuf.data(), scanBuf.size(), &scanCount);
 
-    std::array<std::byte, bufSize> commaBuf{};
+    std::array<std::byte, bufSize> commaBuf;
     goof2::CountingResource commaCount;
     std::pmr::monotonic_buffer_resource commaMr(commaBuf.data(), commaBuf.size(), &commaCount);
 
-    std::array<std::byte, bufSize> copyBuf{};
+    std::array<std::byte, bufSize> copyBuf;
     goof2::CountingResource copyCount;
     std::pmr::monotonic_buffer_resource copyMr(copyBuf.data(), copyBuf.size(), &copyCount);
 
-    std::vector<instruction> localInstructions;
-    localInstructions.reserve(code.size());
-    auto* instructionsPtr = cached ? cached : &localInstructions;
-    bool hasInstructions = cached && !cached->empty();
-    auto& instructions = *instructionsPtr;
-    if (!hasInstructions) {
-        static void* jtable[] = {&&_ADD_SUB,     &&_SET,         &&_PTR_MOV, &&_JMP_ZER,
-                                 &&_JMP_NOT_ZER, &&_PUT_CHR,     &&_RAD_CHR, &&_CLR,
-                                 &&_CLR_RNG,     &&_MUL_CPY,     &&_SCN_RGT, &&_SCN_LFT,
-                                 &&_SCN_CLR_RGT, &&_SCN_CLR_LFT, &&_END};
+    int copyloopCounter = 0;
+    std::pmr::vector<int> copyloopMap{&copyMr};
+    copyloopMap.reserve(code.size() / 2);
 
-        int copyloopCounter = 0;
-        std::pmr::vector<int> copyloopMap{&copyMr};
-        copyloopMap.reserve(code.size() / 2);
+    int scanloopCounter = 0;
+    std::pmr::vector<int> scanloopMap{&scanMr};
+    scanloopMap.reserve(code.size() / 2);
+    std::pmr::vector<uint8_t> scanloopClrMap{&scanMr};
 
-        int scanloopCounter = 0;
-        std::pmr::vector<int> scanloopMap{&scanMr};
-        scanloopMap.reserve(code.size() / 2);
-        std::pmr::vector<uint8_t> scanloopClrMap{&scanMr};
+    scanloopClrMap.reserve(code.size() / 2);
 
-        scanloopClrMap.reserve(code.size() / 2);
+    int streamCounter = 0;
+    std::pmr::vector<uint8_t> streamMap{&commaMr};
 
-        if (optimize) {
-            static goof2::ThreadPool pool;
-            pool.submit([&code]() {
-                    goof2::regexReplaceInplace(code, goof2::vmRegex::nonInstructionRe,
-                                               [](const SvMatch&) { return std::string{}; });
-                })
-                .get();
-            pool.submit([&code]() {
-                    goof2::regexReplaceInplace(
-                        code, goof2::vmRegex::balanceSeqRe, [](const SvMatch& what) {
-                            std::string_view current{what[0].first,
-                                                     static_cast<size_t>(what.length())};
-                            const char first = current[0];
-                            return (first == '+' || first == '-')
-                                       ? goof2::processBalanced(current, '+', '-')
-                                       : goof2::processBalanced(current, '>', '<');
-                        });
-                })
-                .get();
-
-            const std::string baseCode = code;
-            auto clearFuture = pool.submit([baseCode, &clearMr]() {
-                return goof2::regexCollect(
-                    baseCode, goof2::vmRegex::clearLoopRe,
-                    [](const SvMatch&) {
-                        return std::pair<std::string, std::function<void()>>{std::string("C"), {}};
-                    },
-                    &clearMr);
-            });
-            auto scanFuture = pool.submit([baseCode, &scanloopMap, &scanloopClrMap, &scanMr]() {
-                std::pmr::vector<goof2::RegexReplacement> reps{&scanMr};
-                auto collect = [&](const std::regex& re, bool clrFlag) {
-                    auto vec = goof2::regexCollect(
-                        baseCode, re,
-                        [&](const SvMatch& what) {
-                            std::string_view current{what[0].first,
-                                                     static_cast<size_t>(what.length())};
-                            const auto count =
-                                std::ranges::count(current, '>') - std::ranges::count(current, '<');
-                            std::string rep;
-                            if (count > 0)
-                                rep = "R";
-                            else if (count == 0)
-                                rep = std::string(current);
-                            else
-                                rep = "L";
-                            return std::pair<std::string, std::function<void()>>{
-                                std::move(rep), [&, clrFlag, step = std::abs(count)]() {
-                                    if (step > 0) {
-                                        scanloopMap.push_back(step);
-                                        scanloopClrMap.push_back(static_cast<uint8_t>(clrFlag));
-                                    }
-                                }};
-                        },
-                        &scanMr);
-                    reps.insert(reps.end(), vec.begin(), vec.end());
-                };
-                collect(goof2::vmRegex::scanLoopClrRe, true);
-                collect(goof2::vmRegex::scanLoopRe, false);
-                return reps;
-            });
-            auto commaFuture = pool.submit([baseCode, &commaMr]() {
-                return goof2::regexCollect(
-                    baseCode, goof2::vmRegex::commaTrimRe,
-                    [](const SvMatch&) {
-                        return std::pair<std::string, std::function<void()>>{std::string(","), {}};
-                    },
-                    &commaMr);
-            });
+    if (level >= goof2::OptLevel::O1) {
+        const bool loops = level >= goof2::OptLevel::O2;
+        // Independent passes go to the pool; a chunk already running on it does them in order.
+        auto spawn = [pool](auto fn) {
+            return pool ? pool->submit(std::move(fn))
+                        : std::async(std::launch::deferred, std::move(fn));
+        };
+        spawn([&code]() {
+                goof2::regexReplaceInplace(code, goof2::vmRegex::nonInstructionRe,
+                                           [](const SvMatch&) { return std::string{}; });
+            })
+            .get();
+        timer(&goof2::OptReport::filterSeconds);
+        goof2::balanceRuns(code);
+        timer(&goof2::OptReport::balanceSeconds);
+        // Loop idioms from the user's file go first, so their shapes win over the built-in ones.
+        std::shared_ptr<const std::vector<goof2::Idiom>> idioms;
+        {
+            std::lock_guard<std::mutex> lock(idiomMutex);
+            idioms = userIdioms;
+        }
+        if (idioms && !idioms->empty()) {
+            if (report && report->idiomHits.size() != idioms->size()) {
+                report->idiomHits.clear();
+                for (const goof2::Idiom& idiom : *idioms)
+                    report->idiomHits.emplace_back(idiom.name, 0);
+            }
+            bool replaced = false;
+            for (size_t k = 0; k < idioms->size(); ++k) {
+                const goof2::Idiom& idiom = (*idioms)[k];
+                std::vector<std::tuple<size_t, size_t, size_t>> ranges;
+                const std::string before = report ? code : std::string{};
+                goof2::regexReplaceInplace(
+                    code, idiom.pattern,
+                    [&, base = code.data()](const SvMatch& what) {
+                        std::string text;
+                        if (!goof2::expandIdiom(idiom, what, text)) return what.str();
+                        replaced = true;
+                        if (report) {
+                            ++report->idiomHits[k].second;
+                            // A divmod keeps the loop it stands in front of.
+                            if (idiom.builtin != goof2::Idiom::Builtin::Divmod)
+                                ranges.emplace_back(
+                                    what[0].first - base, what[0].second - base,
+                                    static_cast<size_t>(std::ranges::count(text, '[')));
+                        }
+                        return text;
+                    });
+                if (report && !ranges.empty()) replaceLoops(before, ranges, loopOffsets);
+            }
+            // Templates may leave runs side by side.
+            if (replaced) goof2::balanceRuns(code);
+        }
+        timer(&goof2::OptReport::idiomSeconds);
+        // Pass-through loops: [.,] and its variants for the other EOF conventions. The flags
+        // record whether the loop keeps the byte plus one in the cell and whether it resets
+        // the cell before reading.
+        if (loops) {
+            std::vector<std::pair<size_t, size_t>> removed;
+            const std::string before = report ? code : std::string{};
+            goof2::regexReplaceInplace(
+                code, goof2::vmRegex::streamCopyRe,
+                [&streamMap, &removed, report, base = code.data()](const SvMatch& what) {
+                    const std::string_view loop{what[0].first,
+                                                static_cast<size_t>(what.length())};
+                    const bool biased = loop[1] == '-';
+                    const bool reset = loop.find('[', 1) != std::string_view::npos;
+                    streamMap.push_back(static_cast<uint8_t>(biased | (reset << 1)));
+                    if (report)
+                        removed.emplace_back(loop.data() - base,
+                                             loop.data() - base + loop.size());
+                    return std::string("K");
+                });
+            if (report) dropLoops(before, removed, loopOffsets);
+        }
+        timer(&goof2::OptReport::streamSeconds);
+        // The divmod loop of the esolang wiki, `>n 0 d` to `>0 n d-n%d n%d n/d`, gets a D in
+        // front: DIVMOD does the loop's work at once when its scratch cells are clear and d is
+        // not 1, which leaves the loop nothing to do, and otherwise leaves the work to the loop.
+        if (loops)
+            goof2::regexReplaceInplace(code, goof2::vmRegex::divmodRe,
+                                       [&divmods](const SvMatch& what) {
+                                           ++divmods;
+                                           return "D" + what.str();
+                                       });
+        timer(&goof2::OptReport::divmodSeconds);
 
-            // Compute copy-loop replacements in parallel and aggregate with others.
-            auto copyFuture = pool.submit([baseCode, &copyloopMap, &copyMr]() {
-                return goof2::regexCollect(
-                    baseCode, goof2::vmRegex::copyLoopRe,
+        const std::string baseCode = code;
+        auto clearFuture = spawn([baseCode, &clearMr, &foldedClears, report]() {
+            StageTimer timer{report};
+            auto reps = goof2::regexCollect(
+                baseCode, goof2::vmRegex::clearLoopRe,
+                [&foldedClears, report](const SvMatch&) {
+                    std::function<void()> count;
+                    if (report) count = [&foldedClears]() { ++foldedClears; };
+                    return std::pair<std::string, std::function<void()>>{std::string("C"),
+                                                                         std::move(count)};
+                },
+                &clearMr);
+            timer(&goof2::OptReport::clearSeconds);
+            return reps;
+        });
+        auto scanFuture = spawn([baseCode, &scanloopMap, &scanloopClrMap, &scanMr, report]() {
+            StageTimer timer{report};
+            std::pmr::vector<goof2::RegexReplacement> reps{&scanMr};
+            auto collect = [&](const std::regex& re, bool clrFlag) {
+                auto vec = goof2::regexCollect(
+                    baseCode, re,
                     [&](const SvMatch& what) {
-                        int offset = 0;
-                        std::string_view whole{what[0].first, static_cast<size_t>(what.length())};
-                        // Only transform when net movement is zero
-                        if (std::ranges::count(whole, '>') - std::ranges::count(whole, '<') != 0) {
-                            return std::pair<std::string, std::function<void()>>{std::string(whole),
-                                                                                 {}};
-                        }
+                        std::string_view current{what[0].first,
+                                                 static_cast<size_t>(what.length())};
+                        const auto count =
+                            std::ranges::count(current, '>') - std::ranges::count(current, '<');
+                        std::string rep;
+                        if (count > 0)
+                            rep = "R";
+                        else if (count == 0)
+                            rep = std::string(current);
+                        else
+                            rep = "L";
+                        return std::pair<std::string, std::function<void()>>{
+                            std::move(rep), [&, clrFlag, step = std::abs(count)]() {
+                                if (step > 0) {
+                                    scanloopMap.push_back(step);
+                                    scanloopClrMap.push_back(static_cast<uint8_t>(clrFlag));
+                                }
+                            }};
+                    },
+                    &scanMr);
+                reps.insert(reps.end(), vec.begin(), vec.end());
+            };
+            collect(goof2::vmRegex::scanLoopClrRe, true);
+            collect(goof2::vmRegex::scanLoopRe, false);
+            timer(&goof2::OptReport::scanSeconds);
+            return reps;
+        });
+        // Dropping writes before a read is only safe when EOF overwrites the cell.
+        auto commaFuture = spawn([baseCode, &commaMr, &trimmedCommas, eof, loops, report]() {
+            if (eof == 0 || !loops) return std::pmr::vector<goof2::RegexReplacement>{&commaMr};
+            StageTimer timer{report};
+            auto reps = goof2::regexCollect(
+                baseCode, goof2::vmRegex::commaTrimRe,
+                [&trimmedCommas, report](const SvMatch&) {
+                    std::function<void()> count;
+                    if (report) count = [&trimmedCommas]() { ++trimmedCommas; };
+                    return std::pair<std::string, std::function<void()>>{std::string(","),
+                                                                         std::move(count)};
+                },
+                &commaMr);
+            timer(&goof2::OptReport::commaSeconds);
+            return reps;
+        });
+
+        // Compute copy-loop replacements in parallel and aggregate with others.
+        auto copyFuture =
+            spawn([baseCode, &copyloopMap, &copyMr, &foldedCopies, loops, report]() {
+            if (!loops) return std::pmr::vector<goof2::RegexReplacement>{&copyMr};
+            StageTimer timer{report};
+            auto reps = goof2::regexCollect(
+                baseCode, goof2::vmRegex::copyLoopRe,
+                [&](const SvMatch& what) {
+                    int offset = 0;
+                    std::string_view whole{what[0].first, static_cast<size_t>(what.length())};
+                    // Only transform when net movement is zero
+                    if (std::ranges::count(whole, '>') - std::ranges::count(whole, '<') != 0) {
+                        return std::pair<std::string, std::function<void()>>{std::string(whole),
+                                                                             {}};
+                    }
 
-                        // Use a non-owning view of the captured inner sequence, avoid temporary
-                        // string.
-                        std::string_view currentView;
-                        if (what[1].matched) {
-                            currentView = std::string_view{what[1].first,
-                                                           static_cast<size_t>(what[1].length())};
+                    // Use a non-owning view of the captured inner sequence, avoid temporary
+                    // string.
+                    std::string_view currentView;
+                    if (what[1].matched) {
+                        currentView = std::string_view{what[1].first,
+                                                       static_cast<size_t>(what[1].length())};
+                    } else {
+                        currentView = std::string_view{what[2].first,
+                                                       static_cast<size_t>(what[2].length())};
+                    }
+
+                    SvMatch inner;
+                    auto start = currentView.cbegin();
+                    auto end = currentView.cend();
+                    std::pmr::vector<std::pair<int, int>> deltaMap{&copyMr};
+                    while (
+                        std::regex_search(start, end, inner, goof2::vmRegex::copyLoopInnerRe)) {
+                        offset += -std::count(inner[0].first, inner[0].second, '<') +
+                                  std::count(inner[0].first, inner[0].second, '>');
+                        int delta = std::count(inner[0].first, inner[0].second, '+') -
+                                    std::count(inner[0].first, inner[0].second, '-');
+                        auto it =
+                            std::find_if(deltaMap.begin(), deltaMap.end(),
+                                         [offset](const auto& p) { return p.first == offset; });
+                        if (it != deltaMap.end()) {
+                            it->second += delta;
                         } else {
-                            currentView = std::string_view{what[2].first,
-                                                           static_cast<size_t>(what[2].length())};
+                            deltaMap.emplace_back(offset, delta);
                         }
+                        start = inner[0].second;
+                    }
+                    const bool allZero = std::ranges::all_of(
+                        deltaMap, [](const auto& it) { return it.second == 0; });
+                    if (!allZero) {
+                        std::ranges::sort(deltaMap, [](const auto& a, const auto& b) {
+                            return a.first < b.first;
+                        });
+                        const std::size_t cnt = deltaMap.size();
+                        return std::pair<std::string, std::function<void()>>{
+                            std::string(cnt, 'P') + "C", [&, deltaMap = std::move(deltaMap)]() {
+                                ++foldedCopies;
+                                for (const auto& [off, d] : deltaMap) {
+                                    copyloopMap.push_back(off);
+                                    copyloopMap.push_back(d);
+                                }
+                            }};
+                    }
+                    std::function<void()> count;
+                    if (report) count = [&foldedCopies]() { ++foldedCopies; };
+                    return std::pair<std::string, std::function<void()>>{std::string("C"),
+                                                                         std::move(count)};
+                },
+                &copyMr);
+            timer(&goof2::OptReport::copySeconds);
+            return reps;
+        });
 
-                        SvMatch inner;
-                        auto start = currentView.cbegin();
-                        auto end = currentView.cend();
-                        std::pmr::vector<std::pair<int, int>> deltaMap{&copyMr};
-                        while (
-                            std::regex_search(start, end, inner, goof2::vmRegex::copyLoopInnerRe)) {
-                            offset += -std::count(inner[0].first, inner[0].second, '<') +
-                                      std::count(inner[0].first, inner[0].second, '>');
-                            int delta = std::count(inner[0].first, inner[0].second, '+') -
-                                        std::count(inner[0].first, inner[0].second, '-');
-                            auto it =
-                                std::find_if(deltaMap.begin(), deltaMap.end(),
-                                             [offset](const auto& p) { return p.first == offset; });
-                            if (it != deltaMap.end()) {
-                                it->second += delta;
-                            } else {
-                                deltaMap.emplace_back(offset, delta);
-                            }
-                            start = inner[0].second;
-                        }
-                        const bool allZero = std::ranges::all_of(
-                            deltaMap, [](const auto& it) { return it.second == 0; });
-                        if (!allZero) {
-                            std::ranges::sort(deltaMap, [](const auto& a, const auto& b) {
-                                return a.first < b.first;
-                            });
-                            const std::size_t cnt = deltaMap.size();
-                            return std::pair<std::string, std::function<void()>>{
-                                std::string(cnt, 'P') + "C", [&, deltaMap = std::move(deltaMap)]() {
-                                    for (const auto& [off, d] : deltaMap) {
-                                        copyloopMap.push_back(off);
-                                        copyloopMap.push_back(d);
-                                    }
-                                }};
-                        }
-                        return std::pair<std::string, std::function<void()>>{std::string("C"), {}};
-                    },
-                    &copyMr);
-            });
-
-            auto clearReps = clearFuture.get();
-            auto scanReps = scanFuture.get();
-            auto commaReps = commaFuture.get();
-            auto copyReps = copyFuture.get();
-            std::pmr::vector<goof2::RegexReplacement> allReps{&mainMr};
-            allReps.reserve(clearReps.size() + scanReps.size() + commaReps.size() +
-                            copyReps.size());
-            allReps.insert(allReps.end(), clearReps.begin(), clearReps.end());
-            allReps.insert(allReps.end(), scanReps.begin(), scanReps.end());
-            allReps.insert(allReps.end(), commaReps.begin(), commaReps.end());
-            allReps.insert(allReps.end(), copyReps.begin(), copyReps.end());
-            std::sort(allReps.begin(), allReps.end(),
-                      [](const auto& a, const auto& b) { return a.start > b.start; });
-            for (auto& r : allReps) {
-                const size_t rlen = r.end - r.start;
-                bool changed = true;
-                if (rlen == r.text.size()) {
-                    changed =
-                        !std::equal(code.begin() + r.start, code.begin() + r.end, r.text.begin());
-                }
-                if (changed) {
-                    code.replace(r.start, rlen, r.text);
-                }
-                if (r.sideEffect) r.sideEffect();
-            }
+        auto clearReps = clearFuture.get();
+        auto scanReps = scanFuture.get();
+        auto commaReps = commaFuture.get();
+        auto copyReps = copyFuture.get();
+        timer(nullptr);
+        std::pmr::vector<goof2::RegexReplacement> allReps{&mainMr};
+        allReps.reserve(clearReps.size() + scanReps.size() + commaReps.size() +
+                        copyReps.size());
+        allReps.insert(allReps.end(), clearReps.begin(), clearReps.end());
+        allReps.insert(allReps.end(), scanReps.begin(), scanReps.end());
+        allReps.insert(allReps.end(), commaReps.begin(), commaReps.end());
+        allReps.insert(allReps.end(), copyReps.begin(), copyReps.end());
+        std::vector<std::pair<size_t, size_t>> removed;
+        goof2::applyReplacements(code, allReps, report ? &removed : nullptr);
+        if (report) dropLoops(baseCode, removed, loopOffsets);
+        timer(&goof2::OptReport::rewriteSeconds);
+
+        // Single-pass clear transforms: C([+-]+) -> S[+-]+ and C{2,} -> C
+        spawn([&code]() {
+                goof2::regexReplaceInplace(code, goof2::vmRegex::clearPassRe,
+                                           [](const SvMatch& what) {
+                                               if (what[2].matched) {
+                                                   std::string result{"S"};
+                                                   result.append(what[2].first, what[2].second);
+                                                   return result;
+                                               }
+                                               return std::string("C");
+                                           });
+            })
+            .get();
 
-            // Single-pass clear transforms: C([+-]+) -> S[+-]+ and C{2,} -> C
-            pool.submit([&code]() {
-                    goof2::regexReplaceInplace(code, goof2::vmRegex::clearPassRe,
+        // (copy-loop handled in the aggregated, parallel stage above)
+
+        if constexpr (!Term)
+            if (loops) spawn([&code]() {
+                    goof2::regexReplaceInplace(code, goof2::vmRegex::leadingSetRe,
                                                [](const SvMatch& what) {
-                                                   if (what[2].matched) {
-                                                       std::string result{"S"};
-                                                       result.append(what[2].first, what[2].second);
-                                                       return result;
-                                                   }
-                                                   return std::string("C");
+                                                   std::string result;
+                                                   result.append(what[1].first, what[1].second);
+                                                   result += 'S';
+                                                   result.append(what[2].first, what[2].second);
+                                                   return result;
                                                });
                 })
-                .get();
+                .get();  // We can't really assume in term
+        timer(&goof2::OptReport::setSeconds);
 
-            // (copy-loop handled in the aggregated, parallel stage above)
+        // (C-sequence collapse handled in clearPassRe)
+    }
 
-            if constexpr (!Term)
-                pool.submit([&code]() {
-                        goof2::regexReplaceInplace(code, goof2::vmRegex::leadingSetRe,
-                                                   [](const SvMatch& what) {
-                                                       std::string result;
-                                                       result.append(what[1].first, what[1].second);
-                                                       result += 'S';
-                                                       result.append(what[2].first, what[2].second);
-                                                       return result;
-                                                   });
-                    })
-                    .get();  // We can't really assume in term
+    BracketPairs brackets(&mainMr);
+    if (const int err = matchBrackets(code, brackets, &mainMr)) return err;
+    // Balanced loops keep the pointer offset pending before them, so they need no PTR_MOV.
+    const bool hoistLoops = level >= goof2::OptLevel::O2;
+    std::pmr::vector<LoopExtent> loopExtents(&mainMr);
+    if (hoistLoops) {
+        loopExtents.resize(brackets.pos.size());
+        measureLoops(code, loopExtents, &mainMr);
+    }
+    timer(&goof2::OptReport::bracketSeconds);
+    // Loop cache time is taken out of the emit time it falls in.
+    double cacheSeconds = 0.0;
+    uint64_t cacheHits = 0, cacheMisses = 0;
+    auto cacheClock = [report]() {
+        return report ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+    };
+    size_t nextBracket = 0;  // index in brackets of the next '[' or ']' to compile
+    // JMP_ZER index and loop cache key of each open loop, and whether it kept the offset.
+    struct OpenLoop {
+        size_t start;
+        uint64_t hash;
+        bool hoisted;
+    };
+    std::pmr::vector<OpenLoop> openLoops(&mainMr);
+    AffineLoop affine;
+    NestedLoop nested;
+    uint64_t nestedLoops = 0;
+    int16_t offset = 0;
+    bool set = false;
+    ptrdiff_t compilePos = 0, compileMin = 0, compileMax = 0;
+    instructions.reserve(code.length());
 
-            // (C-sequence collapse handled in clearPassRe)
+    const bool fuse = level >= goof2::OptLevel::O3;
+    // Instructions before this index end a skipped block and must not be merged into.
+    size_t fence = 0;
+    auto emit = [&](insType op, instruction inst) {
+        inst.op = op;
+        if (!fuse || instructions.size() == fence) {
+            instructions.push_back(inst);
+            return;
         }
-
-        std::pmr::vector<size_t> braceTable(&mainMr);
-        braceTable.resize(code.length());
-        {
-            std::pmr::vector<size_t> stack(&mainMr);
-            for (size_t i = 0; i < code.length(); ++i) {
-                const char ch = code[i];
-                if (ch == '[') {
-                    stack.push_back(i);
-                } else if (ch == ']') {
-                    if (stack.empty()) return 1;
-                    const size_t start = stack.back();
-                    stack.pop_back();
-                    braceTable[start] = i;
-                    braceTable[i] = start;
+        if (op == insType::CLR && !instructions.empty()) {
+            auto& last = instructions.back();
+            insType lastOp = last.op;
+            if (lastOp == insType::CLR) {
+                if (inst.offset == last.offset + 1) {
+                    last.data = 2;
+                    last.op = insType::CLR_RNG;
+                    return;
+                } else if (inst.offset + 1 == last.offset) {
+                    last.data = 2;
+                    last.offset = inst.offset;
+                    last.op = insType::CLR_RNG;
+                    return;
+                }
+            } else if (lastOp == insType::CLR_RNG) {
+                if (inst.offset == last.offset + last.data) {
+                    last.data++;
+                    return;
+                } else if (inst.offset + 1 == last.offset) {
+                    last.offset = inst.offset;
+                    last.data++;
+                    return;
                 }
             }
-            if (!stack.empty()) return 2;
-        }
-        std::pmr::vector<size_t> braceInst(&mainMr);
-        braceInst.resize(code.length());
-        int16_t offset = 0;
-        bool set = false;
-        ptrdiff_t compilePos = 0, compileMin = 0, compileMax = 0;
-        instructions.reserve(code.length());
-
-        auto emit = [&](insType op, instruction inst) {
-            inst.op = op;
-            if (op == insType::CLR && !instructions.empty()) {
-                auto& last = instructions.back();
-                insType lastOp = last.op;
-                if (lastOp == insType::CLR) {
-                    if (inst.offset == last.offset + 1) {
-                        last.data = 2;
-                        last.op = insType::CLR_RNG;
-                        return;
-                    } else if (inst.offset + 1 == last.offset) {
-                        last.data = 2;
-                        last.offset = inst.offset;
-                        last.op = insType::CLR_RNG;
-                        return;
-                    }
-                } else if (lastOp == insType::CLR_RNG) {
-                    if (inst.offset == last.offset + last.data) {
-                        last.data++;
+        }
+        // ",>,>," reads consecutive cells; do it as one block read.
+        if (op == insType::RAD_CHR && !instructions.empty()) {
+            auto& last = instructions.back();
+            if (last.op == insType::RAD_CHR && last.offset + last.data == inst.offset) {
+                last.data++;
+                return;
+            }
+        }
+        if (!instructions.empty() && instructions.back().offset == inst.offset) {
+            auto& last = instructions.back();
+            insType lastOp = last.op;
+            bool lastIsWrite = lastOp == insType::ADD_SUB || lastOp == insType::SET ||
+                               lastOp == insType::CLR || lastOp == insType::CLR_RNG;
+            bool newIsWrite = op == insType::ADD_SUB || op == insType::SET ||
+                              op == insType::CLR || op == insType::CLR_RNG;
+            if (lastIsWrite && newIsWrite) {
+                if (op == insType::ADD_SUB) {
+                    if (lastOp == insType::ADD_SUB) {
+                        last.data += inst.data;
                         return;
-                    } else if (inst.offset + 1 == last.offset) {
-                        last.offset = inst.offset;
-                        last.data++;
+                    } else if (lastOp == insType::SET) {
+                        last.data = static_cast<CellT>(last.data + inst.data);
                         return;
-                    }
-                }
-            }
-            if (!instructions.empty() && instructions.back().offset == inst.offset) {
-                auto& last = instructions.back();
-                insType lastOp = last.op;
-                bool lastIsWrite = lastOp == insType::ADD_SUB || lastOp == insType::SET ||
-                                   lastOp == insType::CLR || lastOp == insType::CLR_RNG;
-                bool newIsWrite = op == insType::ADD_SUB || op == insType::SET ||
-                                  op == insType::CLR || op == insType::CLR_RNG;
-                if (lastIsWrite && newIsWrite) {
-                    if (op == insType::ADD_SUB) {
-                        if (lastOp == insType::ADD_SUB) {
-                            last.data += inst.data;
-                            return;
-                        } else if (lastOp == insType::SET) {
-                            last.data = static_cast<CellT>(last.data + inst.data);
-                            return;
-                        } else if (lastOp == insType::CLR) {
-                            instructions.pop_back();
-                            instructions.push_back(instruction{
-                                nullptr, static_cast<int32_t>(static_cast<CellT>(inst.data)), 0,
-                                inst.offset, insType::SET});
-                            return;
-                        }
-                    } else {
+                    } else if (lastOp == insType::CLR) {
                         instructions.pop_back();
-                        instructions.push_back(inst);
+                        instructions.push_back(instruction{
+                            nullptr, static_cast<int32_t>(static_cast<CellT>(inst.data)), 0,
+                            inst.offset, insType::SET});
                         return;
                     }
+                } else {
+                    instructions.pop_back();
+                    instructions.push_back(inst);
+                    return;
                 }
             }
-            instructions.push_back(inst);
-        };
+        }
+        instructions.push_back(inst);
+    };
 
 #define MOVEOFFSET()                                                \
     if (offset) [[likely]] {                                        \
@@ -1442,135 +2011,1116 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
         offset = 0;                                                 \
     }
 
-        for (size_t i = 0; i < code.length(); i++) {
-            const unsigned char ch = static_cast<unsigned char>(code[i]);
-            const insType op = charToOpcode[ch];
-            switch (op) {
-                case insType::ADD_SUB: {
-                    if (code[i] == '+') {
-                        const insType actual = set ? insType::SET : insType::ADD_SUB;
-                        emit(actual, instruction{nullptr, fold(code, i, '+'), 0, offset});
-                    } else {
-                        const int32_t folded = -fold(code, i, '-');
-                        const insType actual = set ? insType::SET : insType::ADD_SUB;
-                        emit(actual,
-                             instruction{
-                                 nullptr,
-                                 set ? static_cast<int32_t>(static_cast<CellT>(folded)) : folded, 0,
-                                 offset});
-                    }
-                    set = false;
-                    break;
+    for (size_t i = 0; i < code.length(); i++) {
+        const unsigned char ch = static_cast<unsigned char>(code[i]);
+        const insType op = charToOpcode[ch];
+        switch (op) {
+            case insType::ADD_SUB: {
+                if (code[i] == '+') {
+                    const insType actual = set ? insType::SET : insType::ADD_SUB;
+                    emit(actual, instruction{nullptr, fold(code, i, '+'), 0, offset});
+                } else {
+                    const int32_t folded = -fold(code, i, '-');
+                    const insType actual = set ? insType::SET : insType::ADD_SUB;
+                    emit(actual,
+                         instruction{
+                             nullptr,
+                             set ? static_cast<int32_t>(static_cast<CellT>(folded)) : folded, 0,
+                             offset});
                 }
-                case insType::PTR_MOV: {
-                    if (code[i] == '>') {
-                        int16_t amt = static_cast<int16_t>(fold(code, i, '>'));
-                        offset += amt;
-                        compilePos += amt;
-                    } else {
-                        int16_t amt = static_cast<int16_t>(fold(code, i, '<'));
-                        offset -= amt;
-                        compilePos -= amt;
+                set = false;
+                break;
+            }
+            case insType::PTR_MOV: {
+                const int32_t amt = code[i] == '>' ? fold(code, i, '>') : -fold(code, i, '<');
+                compilePos += amt;
+                // Long loop-free stretches would overflow the 16-bit offset; move the pointer.
+                if (offset + amt > INT16_MAX || offset + amt < INT16_MIN) {
+                    emit(insType::PTR_MOV, instruction{nullptr, offset + amt, 0, 0});
+                    offset = 0;
+                } else {
+                    offset = static_cast<int16_t>(offset + amt);
+                }
+                if (compilePos > compileMax) compileMax = compilePos;
+                if (compilePos < compileMin) compileMin = compilePos;
+                break;
+            }
+            case insType::JMP_ZER: {
+                const bool hoisted = hoistLoops && loopExtents[nextBracket].balanced &&
+                                     offset + loopExtents[nextBracket].low >= INT16_MIN &&
+                                     offset + loopExtents[nextBracket].high <= INT16_MAX;
+                if (!hoisted) MOVEOFFSET();
+                const size_t end = brackets.pos[brackets.partner[nextBracket]];
+                // A loop with a known trip count adds the tested cell times a factor to each
+                // cell it adds to, and sets the cells it sets if it runs at all.
+                if (hoistLoops && brackets.partner[nextBracket] == nextBracket + 1 &&
+                    affineLoop<CellT>(std::string_view(&code[i + 1], end - i - 1), affine)) {
+                    const bool guarded = std::ranges::any_of(
+                        affine.cells, [](const AffineLoop::Cell& cell) { return cell.set; });
+                    const size_t first = instructions.size();
+                    if (guarded) emit(insType::SKP_ZER, instruction{nullptr, 0, 0, offset});
+                    for (const AffineLoop::Cell& cell : affine.cells)
+                        if (!cell.set)
+                            emit(insType::MUL_CPY,
+                                 instruction{nullptr, static_cast<int32_t>(cell.offset),
+                                             static_cast<int16_t>(cell.value),
+                                             offset});
+                    for (const AffineLoop::Cell& cell : affine.cells) {
+                        if (!cell.set) continue;
+                        const int16_t at = static_cast<int16_t>(offset + cell.offset);
+                        if (static_cast<CellT>(cell.value) == 0)
+                            emit(insType::CLR, instruction{nullptr, 0, 0, at});
+                        else
+                            emit(insType::SET,
+                                 instruction{nullptr,
+                                             static_cast<int32_t>(static_cast<CellT>(cell.value)),
+                                             0, at});
+                    }
+                    emit(insType::CLR, instruction{nullptr, 0, 0, offset});
+                    if (guarded) {
+                        instructions[first].data =
+                            static_cast<int32_t>(instructions.size() - 1 - first);
+                        fence = instructions.size();
                     }
-                    if (compilePos > compileMax) compileMax = compilePos;
-                    if (compilePos < compileMin) compileMin = compilePos;
+                    for (size_t k = i + 1; k < end; ++k) {
+                        compilePos += code[k] == '>' ? 1 : code[k] == '<' ? -1 : 0;
+                        compileMin = std::min(compileMin, compilePos);
+                        compileMax = std::max(compileMax, compilePos);
+                    }
+                    i = end;
+                    nextBracket += 2;
                     break;
                 }
-                case insType::JMP_ZER: {
-                    MOVEOFFSET();
-                    const size_t end = braceTable[i];
-                    std::string_view loopSrc(&code[i], end - i + 1);
-                    uint64_t hash = XXH3_64bits(loopSrc.data(), loopSrc.size());
-                    std::lock_guard<std::mutex> loopLock(goof2::getLoopCacheMutex());
-                    auto& lc = goof2::getLoopCache();
-                    auto it = lc.find(hash);
-                    if (it != lc.end()) {
-                        instructions.insert(instructions.end(), it->second.begin(),
-                                            it->second.end());
-                        for (char ch : loopSrc) {
-                            if (ch == '>') {
-                                ++compilePos;
-                                if (compilePos > compileMax) compileMax = compilePos;
-                            } else if (ch == '<') {
-                                --compilePos;
-                                if (compilePos < compileMin) compileMin = compilePos;
-                            }
+                const auto cacheStart = cacheClock();
+                std::string_view loopSrc(&code[i], end - i + 1);
+                // P, R, L and K only name their loops; the side-map entries they stand for, the
+                // cell width SET values were truncated to, the level and the offset the loop
+                // starts at belong in the key too.
+                size_t copies = 0, scans = 0, streams = 0;
+                for (char ch : loopSrc) {
+                    copies += ch == 'P';
+                    scans += ch == 'R' || ch == 'L';
+                    streams += ch == 'K';
+                }
+                uint64_t hash = XXH3_64bits_withSeed(
+                    loopSrc.data(), loopSrc.size(),
+                    sizeof(CellT) | static_cast<uint64_t>(level) << 8 |
+                        static_cast<uint64_t>(static_cast<uint16_t>(offset)) << 16);
+                hash = XXH3_64bits_withSeed(copyloopMap.data() + copyloopCounter,
+                                            2 * copies * sizeof(int), hash);
+                hash = XXH3_64bits_withSeed(scanloopMap.data() + scanloopCounter,
+                                            scans * sizeof(int), hash);
+                hash = XXH3_64bits_withSeed(scanloopClrMap.data() + scanloopCounter, scans, hash);
+                hash = XXH3_64bits_withSeed(streamMap.data() + streamCounter, streams, hash);
+                std::lock_guard<std::mutex> loopLock(goof2::getLoopCacheMutex());
+                auto& lc = goof2::getLoopCache();
+                auto it = lc.find(hash);
+                if (it != lc.end()) {
+                    instructions.insert(instructions.end(), it->second.begin(),
+                                        it->second.end());
+                    fence = instructions.size();
+                    copyloopCounter += static_cast<int>(2 * copies);
+                    scanloopCounter += static_cast<int>(scans);
+                    streamCounter += static_cast<int>(streams);
+                    for (char ch : loopSrc) {
+                        if (ch == '>') {
+                            ++compilePos;
+                            if (compilePos > compileMax) compileMax = compilePos;
+                        } else if (ch == '<') {
+                            --compilePos;
+                            if (compilePos < compileMin) compileMin = compilePos;
                         }
-                        i = end;
-                    } else {
-                        braceInst[i] = instructions.size();
-                        emit(insType::JMP_ZER, instruction{nullptr, 0, 0, 0});
                     }
-                    break;
+                    i = end;
+                    nextBracket = brackets.partner[nextBracket] + 1;
+                    ++cacheHits;
+                } else {
+                    ++nextBracket;
+                    openLoops.push_back(OpenLoop{instructions.size(), hash, hoisted});
+                    emit(insType::JMP_ZER, instruction{nullptr, 0, 0, offset});
+                    ++cacheMisses;
                 }
-                case insType::JMP_NOT_ZER: {
-                    MOVEOFFSET();
-                    const size_t startCode = braceTable[i];
-                    const size_t startInst = braceInst[startCode];
+                if (report)
+                    cacheSeconds +=
+                        std::chrono::duration<double>(cacheClock() - cacheStart).count();
+                break;
+            }
+            case insType::JMP_NOT_ZER: {
+                const auto [startInst, hash, hoisted] = openLoops.back();
+                if (!hoisted) MOVEOFFSET();
+                ++nextBracket;
+                openLoops.pop_back();
+                // A balanced loop whose body ends by clearing the cell it tests runs at most
+                // once. It becomes a block skipped when that cell is zero, with no back edge.
+                const instruction& last = instructions.back();
+                const bool once =
+                    hoisted && instructions.size() > startInst + 1 &&
+                    ((last.op == insType::CLR && last.offset == offset) ||
+                     (last.op == insType::SET && static_cast<CellT>(last.data) == 0 &&
+                      last.offset == offset) ||
+                     (last.op == insType::CLR_RNG && last.offset <= offset &&
+                      offset < last.offset + last.data));
+                if (once) {
+                    instructions[startInst].op = insType::SKP_ZER;
+                    instructions[startInst].data =
+                        static_cast<int32_t>(instructions.size() - 1 - startInst);
+                    fence = instructions.size();
+                } else if (hoisted && nestedLoop<CellT>(instructions.data() + startInst + 1,
+                                                        instructions.data() + instructions.size(),
+                                                        offset, nested)) {
+                    // The body runs once, then the passes left add their sums at once.
+                    instructions[startInst].op = insType::SKP_ZER;
+                    fence = instructions.size();
+                    for (const NestedLoop::Term& term : nested.terms) {
+                        if (term.source == 0)
+                            emit(insType::MUL_CPY,
+                                 instruction{nullptr, term.target, term.factor, offset});
+                        else
+                            emit(insType::MUL_PRD,
+                                 instruction{nullptr,
+                                             static_cast<uint16_t>(term.target) |
+                                                 static_cast<int32_t>(term.source) << 16,
+                                             term.factor, offset});
+                    }
+                    emit(insType::CLR, instruction{nullptr, 0, 0, offset});
+                    instructions[startInst].data =
+                        static_cast<int32_t>(instructions.size() - 1 - startInst);
+                    fence = instructions.size();
+                    ++nestedLoops;
+                } else {
                     const int sizeminstart = instructions.size() - startInst;
                     instructions[startInst].data = sizeminstart;
-                    emit(insType::JMP_NOT_ZER, instruction{nullptr, sizeminstart, 0, 0});
-                    std::string_view loopSrc(&code[startCode], i - startCode + 1);
-                    uint64_t hash = XXH3_64bits(loopSrc.data(), loopSrc.size());
-                    std::lock_guard<std::mutex> loopLock(goof2::getLoopCacheMutex());
-                    auto& lc = goof2::getLoopCache();
-                    if (lc.find(hash) == lc.end()) {
-                        lc.emplace(hash, std::vector<instruction>(instructions.begin() + startInst,
-                                                                  instructions.end()));
-                    }
-                    break;
+                    emit(insType::JMP_NOT_ZER, instruction{nullptr, sizeminstart, 0, offset});
                 }
-                case insType::PUT_CHR:
-                    emit(insType::PUT_CHR, instruction{nullptr, fold(code, i, '.'), 0, offset});
-                    break;
-                case insType::RAD_CHR:
-                    emit(insType::RAD_CHR, instruction{nullptr, 0, 0, offset});
-                    break;
-                case insType::CLR:
-                    emit(insType::CLR, instruction{nullptr, 0, 0, offset});
-                    break;
-                case insType::MUL_CPY:
-                    emit(insType::MUL_CPY,
-                         instruction{nullptr, copyloopMap[copyloopCounter++],
-                                     static_cast<int16_t>(copyloopMap[copyloopCounter++]), offset});
-                    break;
-                case insType::SCN_RGT:
-                case insType::SCN_LFT: {
-                    MOVEOFFSET();
-                    const auto step = scanloopMap[scanloopCounter];
-                    const bool clr = scanloopClrMap[scanloopCounter++] != 0;
-                    emit(op == insType::SCN_RGT ? (clr ? insType::SCN_CLR_RGT : insType::SCN_RGT)
-                                                : (clr ? insType::SCN_CLR_LFT : insType::SCN_LFT),
-                         instruction{nullptr, step, 0, 0});
-                    break;
+                const auto cacheStart = cacheClock();
+                std::lock_guard<std::mutex> loopLock(goof2::getLoopCacheMutex());
+                auto& lc = goof2::getLoopCache();
+                if (lc.find(hash) == lc.end()) {
+                    lc.emplace(hash, std::vector<instruction>(instructions.begin() + startInst,
+                                                              instructions.end()));
                 }
-                default:
-                    if (code[i] == 'S') set = true;
-                    break;
+                if (report)
+                    cacheSeconds +=
+                        std::chrono::duration<double>(cacheClock() - cacheStart).count();
+                break;
+            }
+            case insType::PUT_CHR:
+                emit(insType::PUT_CHR, instruction{nullptr, fold(code, i, '.'), 0, offset});
+                break;
+            case insType::RAD_CHR:
+                emit(insType::RAD_CHR, instruction{nullptr, 1, 0, offset});
+                break;
+            case insType::CLR:
+                emit(insType::CLR, instruction{nullptr, 0, 0, offset});
+                break;
+            case insType::STREAM_COPY: {
+                const uint8_t flags = streamMap[streamCounter++];
+                emit(insType::STREAM_COPY,
+                     instruction{nullptr, flags & 1, static_cast<int16_t>(flags >> 1), offset});
+                break;
+            }
+            case insType::MUL_CPY:
+                emit(insType::MUL_CPY,
+                     instruction{nullptr, copyloopMap[copyloopCounter++],
+                                 static_cast<int16_t>(copyloopMap[copyloopCounter++]), offset});
+                break;
+            case insType::DIVMOD:
+                // It reaches six cells past the one it divides.
+                if (offset > INT16_MAX - 6) MOVEOFFSET();
+                emit(insType::DIVMOD, instruction{nullptr, 0, 0, offset});
+                break;
+            case insType::SCN_RGT:
+            case insType::SCN_LFT: {
+                MOVEOFFSET();
+                const auto step = scanloopMap[scanloopCounter];
+                const bool clr = scanloopClrMap[scanloopCounter++] != 0;
+                emit(op == insType::SCN_RGT ? (clr ? insType::SCN_CLR_RGT : insType::SCN_RGT)
+                                            : (clr ? insType::SCN_CLR_LFT : insType::SCN_LFT),
+                     instruction{nullptr, step, 0, 0});
+                break;
+            }
+            default:
+                if (code[i] == 'S') set = true;
+                break;
+        }
+    }
+    MOVEOFFSET();
+#undef MOVEOFFSET
+    timer(&goof2::OptReport::emitSeconds);
+    if (report) {
+        report->emitSeconds -= cacheSeconds;
+        report->loopCacheSeconds += cacheSeconds;
+        report->loopCacheHits += cacheHits;
+        report->loopCacheMisses += cacheMisses;
+        report->clearLoops += foldedClears;
+        report->scanLoops += scanloopMap.size();
+        report->copyLoops += foldedCopies;
+        report->streamLoops += streamMap.size();
+        report->divmodLoops += divmods;
+        report->commaTrims += trimmedCommas;
+        report->sets += static_cast<uint64_t>(std::ranges::count(code, 'S'));
+        size_t loop = 0, closed = 0;
+        for (size_t b = 0; b < brackets.pos.size(); ++b) {
+            const size_t at = brackets.pos[b];
+            if (code[at] != '[') continue;
+            const size_t close = brackets.partner[b];
+            // Outer loops are left for the loops inside them.
+            if (close == b + 1) {
+                const std::string_view body(code.data() + at + 1, brackets.pos[close] - at - 1);
+                if (hoistLoops && affineLoop<CellT>(body, affine))
+                    ++closed;
+                else if (loop < loopOffsets.size())
+                    report->missed.push_back(
+                        goof2::OptRemark{loopOffsets[loop], missedReason(body, level)});
             }
+            ++loop;
         }
-        if (static_cast<size_t>(compileMax - compileMin + 1) > span)
-            span = static_cast<size_t>(compileMax - compileMin + 1);
-        MOVEOFFSET();
-        emit(insType::END, instruction{nullptr, 0, 0, 0});
+        report->copyLoops += closed + nestedLoops;
+        report->loopsLeft += loop - closed - nestedLoops;
+    }
+    stats.endPos = compilePos;
+    stats.minPos = compileMin;
+    stats.maxPos = compileMax;
+    stats.heapBytes = mainCount.bytes + clearCount.bytes + scanCount.bytes + commaCount.bytes +
+                      copyCount.bytes;
+    return 0;
+}
 
-        instructions.shrink_to_fit();
-        for (auto& inst : instructions) {
-            inst.jump = jtable[static_cast<size_t>(inst.op)];
+goof2::ThreadPool& compilePool() {
+    static goof2::ThreadPool pool;
+    return pool;
+}
+
+// Start offsets of the slices compiled in parallel. Each cut follows a top-level ']' at least
+// chunk bytes after the previous cut, so every slice starts on a zero cell and holds whole
+// loops. Sources with an unmatched ']' are not split.
+std::vector<size_t> compileCuts(std::string_view code, size_t chunk) {
+    std::vector<size_t> cuts{0};
+    if (code.size() < 2 * chunk) return cuts;
+    ptrdiff_t depth = 0;
+    size_t next = chunk;
+    auto visit = [&](size_t at) {
+        depth += code[at] == '[' ? 1 : -1;
+        if (depth == 0 && at + 1 >= next && at + 1 < code.size()) {
+            cuts.push_back(at + 1);
+            next = at + 1 + chunk;
         }
+        return depth >= 0;
+    };
+    size_t i = 0;
+    for (; i + 32 <= code.size(); i += 32) {
+        uint32_t mask = byteMask(code.data() + i, '[') | byteMask(code.data() + i, ']');
+        for (; mask; mask &= mask - 1)
+            if (!visit(i + tzcnt32(mask))) return {0};
     }
-    if (profile) {
-        profile->heapBytes += mainCount.bytes + clearCount.bytes + scanCount.bytes +
-                              commaCount.bytes + copyCount.bytes;
+    for (; i < code.size(); ++i)
+        if ((code[i] == '[' || code[i] == ']') && !visit(i)) return {0};
+    return cuts;
+}
+
+// Compiles code, splitting large sources at top-level loops and compiling the slices on the
+// pool. Jumps are relative, so the slices' instructions are concatenated unchanged; code is left
+// holding the optimized slices in order. With a session every source is sliced, slices compiled
+// before are taken from it and the new ones are added. A report covers the slices compiled.
+template <typename CellT, bool Term>
+int compileSource(std::string& code, goof2::OptLevel level, int eof,
+                  std::vector<instruction>& instructions, ChunkStats& stats,
+                  goof2::CompileSession* session, goof2::OptReport* report) {
+    goof2::ThreadPool& pool = compilePool();
+    const std::vector<size_t> cuts =
+        compileCuts(code, session ? kSessionSliceSize : sliceSize.load(std::memory_order_relaxed));
+    if (cuts.size() == 1 && !session)
+        return compileChunk<CellT, Term>(code, level, eof, &pool, instructions, stats, report);
+
+    struct Slice {
+        std::string code;
+        std::vector<instruction> instructions;
+        ChunkStats stats;
+        uint64_t key = 0;
+        const goof2::CompiledSlice* hit = nullptr;
+        goof2::OptReport report;
+    };
+    // Everything that changes how a slice compiles, apart from its text.
+    const uint64_t seed = (static_cast<uint64_t>(level) | static_cast<uint64_t>(Term) << 3 |
+                           static_cast<uint64_t>(eof) << 4 | sizeof(CellT) << 6) ^
+                          idiomsKey.load(std::memory_order_relaxed);
+    std::vector<Slice> slices(cuts.size());
+    std::vector<size_t> todo;
+    for (size_t k = 0; k < cuts.size(); ++k) {
+        const size_t end = k + 1 < cuts.size() ? cuts[k + 1] : code.size();
+        Slice& slice = slices[k];
+        const std::string_view source = std::string_view(code).substr(cuts[k], end - cuts[k]);
+        if (session) {
+            slice.key = XXH3_64bits_withSeed(source.data(), source.size(), seed);
+            auto it = session->slices.find(slice.key);
+            if (it != session->slices.end() && it->second.source == source) {
+                slice.hit = &it->second;
+                continue;
+            }
+        }
+        slice.code.assign(source);
+        todo.push_back(k);
+    }
+    std::vector<std::string> sources;
+    if (session) {
+        sources.reserve(todo.size());
+        for (size_t k : todo) sources.push_back(slices[k].code);
+    }
+    // A lone slice keeps the pool for its own regex passes.
+    auto compile = [&slices, &pool, level, eof, report, lone = todo.size() == 1](size_t k) {
+        Slice& slice = slices[k];
+        return compileChunk<CellT, Term>(slice.code, level, eof, lone ? &pool : nullptr,
+                                         slice.instructions, slice.stats,
+                                         report ? &slice.report : nullptr);
+    };
+    int ret = 0;
+    if (!todo.empty()) {
+        std::vector<std::future<int>> pending;
+        pending.reserve(todo.size() - 1);
+        for (size_t t = 1; t < todo.size(); ++t) pending.push_back(pool.submit(compile, todo[t]));
+        ret = compile(todo[0]);
+        for (auto& f : pending) {
+            const int err = f.get();
+            if (!ret) ret = err;
+        }
+    }
+    if (ret) return ret;
+    if (report)
+        for (size_t k : todo) addReport(*report, slices[k].report, cuts[k]);
+    if (session) {
+        // Slices taken from the session point into it, so it is only emptied when nothing was.
+        if (session->slices.size() + todo.size() > kSessionMaxSlices &&
+            todo.size() == slices.size())
+            session->slices.clear();
+        for (size_t t = 0; t < todo.size(); ++t) {
+            Slice& slice = slices[todo[t]];
+            // On a hash collision the slice already stored keeps its place.
+            auto [it, added] = session->slices.try_emplace(slice.key);
+            if (!added) continue;
+            it->second = goof2::CompiledSlice{std::move(sources[t]), std::move(slice.code),
+                                              std::move(slice.instructions), slice.stats.endPos,
+                                              slice.stats.minPos, slice.stats.maxPos};
+            slice.hit = &it->second;
+        }
     }
 
-    auto insp = instructions.data();
-    [[maybe_unused]] std::vector<std::pair<size_t, CellT>> sparseTape;
-    [[maybe_unused]] size_t sparseIndex = cellPtr;
-    [[maybe_unused]] size_t sparseMaxIndex = 0;
-    CellT* __restrict cellBase = cells.data();
-    CellT* __restrict cell = cellBase + cellPtr;
+    size_t total = 0, length = 0;
+    for (const Slice& slice : slices) {
+        total += slice.hit ? slice.hit->instructions.size() : slice.instructions.size();
+        length += slice.hit ? slice.hit->optimized.size() : slice.code.size();
+    }
+    instructions.reserve(total + 1);
+    code.clear();
+    code.reserve(length);
+    ptrdiff_t base = 0;
+    for (const Slice& slice : slices) {
+        const ChunkStats sliceStats =
+            slice.hit ? ChunkStats{slice.hit->endPos, slice.hit->minPos, slice.hit->maxPos, 0}
+                      : slice.stats;
+        const std::vector<instruction>& sliceInstructions =
+            slice.hit ? slice.hit->instructions : slice.instructions;
+        instructions.insert(instructions.end(), sliceInstructions.begin(),
+                            sliceInstructions.end());
+        code += slice.hit ? slice.hit->optimized : slice.code;
+        stats.minPos = std::min(stats.minPos, base + sliceStats.minPos);
+        stats.maxPos = std::max(stats.maxPos, base + sliceStats.maxPos);
+        stats.heapBytes += sliceStats.heapBytes;
+        base += sliceStats.endPos;
+    }
+    stats.endPos = base;
+    return 0;
+}
+
+// Adds to writes the cells the loop or skipped block opened at ins[begin] may write, relative to
+// the pointer at its start. Returns false when an iteration can leave the pointer somewhere else.
+bool loopWrites(const std::vector<instruction>& ins, size_t begin, std::vector<ptrdiff_t>& writes) {
+    const size_t end = begin + static_cast<size_t>(ins[begin].data) +
+                       (ins[begin].op == insType::SKP_ZER ? 1 : 0);
+    std::vector<ptrdiff_t> opened{0};
+    ptrdiff_t pos = 0;
+    auto range = [&](ptrdiff_t from, ptrdiff_t count) {
+        for (ptrdiff_t k = 0; k < count; ++k) writes.push_back(pos + from + k);
+    };
+    for (size_t j = begin + 1; j < end; ++j) {
+        const instruction& inst = ins[j];
+        switch (inst.op) {
+            case insType::ADD_SUB:
+            case insType::SET:
+            case insType::CLR:
+            case insType::STREAM_COPY:
+                range(inst.offset, 1);
+                break;
+            case insType::CLR_RNG:
+            case insType::RAD_CHR:
+                range(inst.offset, inst.data);
+                break;
+            case insType::MUL_CPY:
+                range(inst.offset + inst.data, 1);
+                break;
+            case insType::MUL_PRD:
+                range(inst.offset + static_cast<int16_t>(inst.data), 1);
+                break;
+            case insType::DIVMOD:
+                range(inst.offset, 5);
+                break;
+            case insType::PTR_MOV:
+                pos += inst.data;
+                break;
+            case insType::JMP_ZER:
+                opened.push_back(pos);
+                break;
+            case insType::JMP_NOT_ZER:
+                if (pos != opened.back()) return false;
+                opened.pop_back();
+                break;
+            case insType::SCN_RGT:
+            case insType::SCN_LFT:
+            case insType::SCN_CLR_RGT:
+            case insType::SCN_CLR_LFT:
+                return false;
+            default:
+                break;
+        }
+    }
+    return pos == 0;
+}
+
+// Folds what is known about the tape of a run that starts on zeroed cells. Cell values are
+// followed through straight-line code and across loops that leave the pointer where it was;
+// such a loop ends on a zero cell and makes every cell it writes unknown. Loops and scans
+// entered on a zero cell are dropped, skipped blocks entered on a known nonzero cell become
+// straight-line code, additions to known cells become sets and scans over
+// known cells become plain moves. The pass stops at the first loop or scan that moves the
+// pointer by an unknown amount and at the first cell before the start. Jumps are still
+// relative, and only whole top-level loops are dropped, so the loops kept need no patching.
+// Returns the number of loops dropped.
+template <typename CellT>
+uint64_t foldKnownTape(std::vector<instruction>& ins) {
+    struct Fact {
+        bool known;
+        CellT value;
+    };
+    // Cells not listed are still zero.
+    std::unordered_map<ptrdiff_t, Fact> facts;
+    auto fact = [&facts](ptrdiff_t at) {
+        const auto it = facts.find(at);
+        return it == facts.end() ? Fact{true, 0} : it->second;
+    };
+    auto fitsData = [](CellT value) {
+        return static_cast<CellT>(static_cast<int32_t>(value)) == value;
+    };
+    auto fitsOffset = [](ptrdiff_t offset) { return offset >= INT16_MIN && offset <= INT16_MAX; };
+    std::vector<instruction> out;
+    out.reserve(ins.size());
+    std::vector<ptrdiff_t> writes;
+    ptrdiff_t ptr = 0;
+    uint64_t dropped = 0;
+    size_t i = 0;
+    for (; i < ins.size(); ++i) {
+        const instruction& inst = ins[i];
+        const ptrdiff_t at = ptr + inst.offset;
+        // Leave a program that steps before its start to fail where it did.
+        if (at < 0 || ptr < 0) break;
+        bool stop = false;
+        switch (inst.op) {
+            case insType::ADD_SUB: {
+                const Fact f = fact(at);
+                const CellT value = static_cast<CellT>(f.value + static_cast<CellT>(inst.data));
+                if (f.known && fitsData(value))
+                    out.push_back(instruction{nullptr, static_cast<int32_t>(value), 0,
+                                              inst.offset, insType::SET});
+                else
+                    out.push_back(inst);
+                if (f.known) facts[at] = Fact{true, value};
+                break;
+            }
+            case insType::SET:
+            case insType::CLR: {
+                const CellT value =
+                    inst.op == insType::SET ? static_cast<CellT>(inst.data) : CellT(0);
+                const Fact f = fact(at);
+                if (!f.known || f.value != value) out.push_back(inst);
+                facts[at] = Fact{true, value};
+                break;
+            }
+            case insType::CLR_RNG:
+                out.push_back(inst);
+                for (int32_t k = 0; k < inst.data; ++k) facts[at + k] = Fact{true, 0};
+                break;
+            case insType::RAD_CHR:
+                out.push_back(inst);
+                for (int32_t k = 0; k < inst.data; ++k) facts[at + k] = Fact{false, 0};
+                break;
+            case insType::PTR_MOV:
+                out.push_back(inst);
+                ptr += inst.data;
+                break;
+            case insType::MUL_CPY: {
+                const Fact src = fact(at);
+                const ptrdiff_t to = at + inst.data;
+                const Fact dst = fact(to);
+                const CellT add = static_cast<CellT>(src.value * static_cast<CellT>(inst.auxData));
+                if (src.known && add == 0) break;
+                const ptrdiff_t toOffset = inst.offset + inst.data;
+                if (src.known && fitsOffset(toOffset)) {
+                    const CellT value = static_cast<CellT>(dst.value + add);
+                    if (dst.known && fitsData(value)) {
+                        out.push_back(instruction{nullptr, static_cast<int32_t>(value), 0,
+                                                  static_cast<int16_t>(toOffset), insType::SET});
+                        facts[to] = Fact{true, value};
+                        break;
+                    }
+                    if (fitsData(add)) {
+                        out.push_back(instruction{nullptr, static_cast<int32_t>(add), 0,
+                                                  static_cast<int16_t>(toOffset),
+                                                  insType::ADD_SUB});
+                        if (dst.known) facts[to] = Fact{true, value};
+                        break;
+                    }
+                }
+                out.push_back(inst);
+                facts[to] = Fact{dst.known && src.known, static_cast<CellT>(dst.value + add)};
+                break;
+            }
+            case insType::STREAM_COPY: {
+                const Fact f = fact(at);
+                if (f.known && f.value == 0) break;
+                out.push_back(inst);
+                facts[at] = Fact{true, 0};
+                break;
+            }
+            case insType::MUL_PRD: {
+                const Fact count = fact(at), src = fact(at + (inst.data >> 16));
+                if ((count.known && count.value == 0) || (src.known && src.value == 0)) break;
+                out.push_back(inst);
+                facts[at + static_cast<int16_t>(inst.data)] = Fact{false, 0};
+                break;
+            }
+            case insType::DIVMOD: {
+                const Fact f = fact(at);
+                if (f.known && f.value == 0) break;
+                out.push_back(inst);
+                for (ptrdiff_t k = 0; k < 5; ++k) facts[at + k] = Fact{false, 0};
+                break;
+            }
+            case insType::SCN_RGT:
+            case insType::SCN_LFT:
+            case insType::SCN_CLR_RGT:
+            case insType::SCN_CLR_LFT: {
+                const Fact f = fact(ptr);
+                if (f.known && f.value == 0) break;
+                const bool right = inst.op == insType::SCN_RGT || inst.op == insType::SCN_CLR_RGT;
+                const bool clear =
+                    inst.op == insType::SCN_CLR_RGT || inst.op == insType::SCN_CLR_LFT;
+                const ptrdiff_t step = right ? inst.data : -static_cast<ptrdiff_t>(inst.data);
+                // Walk the known cells to the zero the scan stops on.
+                ptrdiff_t p = ptr;
+                for (Fact g = f; g.known && g.value != 0 && fitsOffset(p - ptr) && p >= 0;
+                     g = fact(p))
+                    p += step;
+                const Fact end = fact(p);
+                if (!end.known || end.value != 0 || !fitsOffset(p - ptr) || p < 0) {
+                    stop = true;
+                    break;
+                }
+                if (clear)
+                    for (ptrdiff_t q = ptr; q != p; q += step) {
+                        out.push_back(instruction{nullptr, 0, 0, static_cast<int16_t>(q - ptr),
+                                                  insType::CLR});
+                        facts[q] = Fact{true, 0};
+                    }
+                out.push_back(instruction{nullptr, static_cast<int32_t>(p - ptr), 0, 0,
+                                          insType::PTR_MOV});
+                ptr = p;
+                break;
+            }
+            case insType::JMP_ZER: {
+                const size_t end = i + static_cast<size_t>(inst.data);
+                const Fact f = fact(at);
+                if (!(f.known && f.value == 0)) {
+                    writes.clear();
+                    if (!loopWrites(ins, i, writes)) {
+                        stop = true;
+                        break;
+                    }
+                    out.insert(out.end(), ins.begin() + i, ins.begin() + end + 1);
+                    for (ptrdiff_t w : writes) facts[ptr + w] = Fact{false, 0};
+                    facts[at] = Fact{true, 0};
+                } else {
+                    ++dropped;
+                }
+                i = end;
+                break;
+            }
+            case insType::SKP_ZER: {
+                const Fact f = fact(at);
+                if (f.known && f.value == 0) {
+                    ++dropped;
+                    i += static_cast<size_t>(inst.data);
+                    break;
+                }
+                if (f.known) break;  // the block runs, once
+                writes.clear();
+                if (!loopWrites(ins, i, writes)) {
+                    stop = true;
+                    break;
+                }
+                const size_t end = i + static_cast<size_t>(inst.data);
+                out.insert(out.end(), ins.begin() + i, ins.begin() + end + 1);
+                for (ptrdiff_t w : writes) facts[ptr + w] = Fact{false, 0};
+                facts[at] = Fact{true, 0};
+                i = end;
+                break;
+            }
+            default:
+                out.push_back(inst);
+                break;
+        }
+        if (stop) break;
+    }
+    out.insert(out.end(), ins.begin() + i, ins.end());
+    ins.swap(out);
+    return dropped;
+}
+
+// WRITE_STR keeps its bytes in the instructions after it; this is how many it takes.
+constexpr size_t strSlots(int32_t bytes) {
+    return (static_cast<size_t>(bytes) + sizeof(instruction) - 1) / sizeof(instruction);
+}
+
+// Appends WRITE_STR instructions that write bytes, each followed by the slots holding its part.
+void appendWriteStr(std::vector<instruction>& out, std::string_view bytes) {
+    constexpr size_t kChunk = size_t(1) << 30;
+    for (size_t at = 0; at < bytes.size(); at += kChunk) {
+        const size_t size = std::min(kChunk, bytes.size() - at);
+        out.push_back(instruction{nullptr, static_cast<int32_t>(size), 0, 0, insType::WRITE_STR});
+        const size_t first = out.size();
+        out.resize(first + strSlots(static_cast<int32_t>(size)));
+        std::memcpy(static_cast<void*>(out.data() + first), bytes.data() + at, size);
+    }
+}
+
+// A run of a program on a zeroed tape at compile time.
+template <typename CellT>
+struct EvalState {
+    std::vector<CellT> tape;  // the cells touched so far
+    std::string output;
+    ptrdiff_t ptr = 0;
+    uint64_t steps = 0;
+};
+
+// Runs ins from the start until it reaches instruction stopAt, reads input, leaves the cells it
+// may use or has spent budget steps. Returns the index of the first instruction it did not run,
+// ins.size() when the program ended.
+template <typename CellT>
+size_t evalPrefix(const std::vector<instruction>& ins, size_t stopAt, uint64_t budget,
+                  EvalState<CellT>& st) {
+    auto inRange = [](ptrdiff_t at) { return at >= 0 && at < kEvalCells; };
+    auto cellAt = [&st](ptrdiff_t at) -> CellT& {
+        if (static_cast<size_t>(at) >= st.tape.size()) st.tape.resize(at + 1, 0);
+        return st.tape[at];
+    };
+    size_t i = 0;
+    for (; i < ins.size() && i != stopAt; ++i) {
+        const instruction& inst = ins[i];
+        const ptrdiff_t at = st.ptr + inst.offset;
+        if (st.steps >= budget || !inRange(at)) break;
+        ++st.steps;
+        bool halt = false;
+        switch (inst.op) {
+            case insType::ADD_SUB:
+                cellAt(at) += static_cast<CellT>(inst.data);
+                break;
+            case insType::SET:
+                cellAt(at) = static_cast<CellT>(inst.data);
+                break;
+            case insType::CLR:
+                cellAt(at) = 0;
+                break;
+            case insType::CLR_RNG:
+                if (!inRange(at + inst.data)) {
+                    halt = true;
+                    break;
+                }
+                for (int32_t k = 0; k < inst.data; ++k) cellAt(at + k) = 0;
+                st.steps += static_cast<uint64_t>(inst.data);
+                break;
+            case insType::PTR_MOV:
+                if (!inRange(st.ptr + inst.data)) {
+                    halt = true;
+                    break;
+                }
+                st.ptr += inst.data;
+                break;
+            case insType::JMP_ZER:
+                if (!cellAt(at)) i += static_cast<size_t>(inst.data);
+                break;
+            case insType::JMP_NOT_ZER:
+                if (cellAt(at)) i -= static_cast<size_t>(inst.data);
+                break;
+            case insType::SKP_ZER:
+                if (!cellAt(at)) i += static_cast<size_t>(inst.data);
+                break;
+            case insType::PUT_CHR: {
+                const uint64_t count = static_cast<uint64_t>(inst.data);
+                if (count > budget - st.steps) {
+                    halt = true;
+                    break;
+                }
+                st.output.append(count, static_cast<char>(cellAt(at)));
+                st.steps += count;
+                break;
+            }
+            case insType::MUL_CPY: {
+                if (!inRange(at + inst.data)) {
+                    halt = true;
+                    break;
+                }
+                const CellT add = static_cast<CellT>(cellAt(at) * static_cast<CellT>(inst.auxData));
+                cellAt(at + inst.data) += add;
+                break;
+            }
+            case insType::MUL_PRD: {
+                const ptrdiff_t to = at + static_cast<int16_t>(inst.data);
+                const ptrdiff_t from = at + (inst.data >> 16);
+                if (!inRange(to) || !inRange(from)) {
+                    halt = true;
+                    break;
+                }
+                cellAt(to) += static_cast<CellT>(static_cast<uint64_t>(cellAt(at)) *
+                                                 cellAt(from) * static_cast<CellT>(inst.auxData));
+                break;
+            }
+            case insType::DIVMOD: {
+                if (!inRange(at + 6)) {
+                    halt = true;
+                    break;
+                }
+                const CellT n = cellAt(at), d = cellAt(at + 2);
+                if (!n || d == 1 || cellAt(at + 3) || cellAt(at + 5) || cellAt(at + 6)) break;
+                const CellT rem = d ? static_cast<CellT>(n % d) : n;
+                cellAt(at) = 0;
+                cellAt(at + 1) += n;
+                cellAt(at + 2) = static_cast<CellT>(d - rem);
+                cellAt(at + 3) = rem;
+                cellAt(at + 4) += d ? static_cast<CellT>(n / d) : CellT(0);
+                break;
+            }
+            case insType::SCN_RGT:
+            case insType::SCN_LFT:
+            case insType::SCN_CLR_RGT:
+            case insType::SCN_CLR_LFT: {
+                const bool right = inst.op == insType::SCN_RGT || inst.op == insType::SCN_CLR_RGT;
+                const ptrdiff_t step = right ? inst.data : -static_cast<ptrdiff_t>(inst.data);
+                // Find where the scan stops before changing anything.
+                ptrdiff_t p = st.ptr;
+                while (inRange(p) && st.steps < budget && cellAt(p)) {
+                    p += step;
+                    ++st.steps;
+                }
+                if (!inRange(p) || cellAt(p)) {
+                    halt = true;
+                    break;
+                }
+                if (inst.op == insType::SCN_CLR_RGT || inst.op == insType::SCN_CLR_LFT)
+                    for (ptrdiff_t q = st.ptr; q != p; q += step) st.tape[q] = 0;
+                st.ptr = p;
+                break;
+            }
+            default:  // input, and anything else the compiler cannot run
+                halt = true;
+                break;
+        }
+        if (halt) break;
+    }
+    return i;
+}
+
+// Runs the input-free start of a program at compile time and puts its output and the tape it
+// leaves in place of it: a WRITE_STR of the output, sets of the cells and a move to where the
+// pointer was. The run goes on to the first read, the end of the program or the end of budget,
+// and the program resumes from the last top-level instruction it reached, so every loop kept is
+// whole. Returns the number of instructions run ahead of time, or 0 when nothing was replaced.
+template <typename CellT>
+uint64_t bakePrefix(std::vector<instruction>& ins, uint64_t budget) {
+    EvalState<CellT> st;
+    const size_t stopped = evalPrefix(ins, ins.size(), budget, st);
+    size_t resume = 0;
+    while (resume < stopped) {
+        const insType op = ins[resume].op;
+        const size_t next = op == insType::JMP_ZER || op == insType::SKP_ZER
+                                ? resume + static_cast<size_t>(ins[resume].data) + 1
+                                : resume + 1;
+        if (next > stopped) break;
+        resume = next;
+    }
+    if (resume == 0) return 0;
+    if (resume != stopped) {
+        st = EvalState<CellT>{};
+        evalPrefix(ins, resume, budget, st);
+    }
+    for (CellT value : st.tape)
+        if (static_cast<CellT>(static_cast<int32_t>(value)) != value) return 0;
+
+    std::vector<instruction> out;
+    appendWriteStr(out, st.output);
+    // Move to the last cell touched first, so a fixed tape too short for the program fails as it
+    // did, then set the cells on the way back.
+    ptrdiff_t pos = 0;
+    if (st.tape.size() > 1) {
+        pos = static_cast<ptrdiff_t>(st.tape.size()) - 1;
+        out.push_back(instruction{nullptr, static_cast<int32_t>(pos), 0, 0, insType::PTR_MOV});
+    }
+    for (ptrdiff_t j = static_cast<ptrdiff_t>(st.tape.size()) - 1; j >= 0; --j) {
+        if (!st.tape[j]) continue;
+        if (j - pos < INT16_MIN) {
+            out.push_back(instruction{nullptr, static_cast<int32_t>(j - pos), 0, 0,
+                                      insType::PTR_MOV});
+            pos = j;
+        }
+        out.push_back(instruction{nullptr, static_cast<int32_t>(st.tape[j]), 0,
+                                  static_cast<int16_t>(j - pos), insType::SET});
+    }
+    if (st.ptr != pos)
+        out.push_back(instruction{nullptr, static_cast<int32_t>(st.ptr - pos), 0, 0,
+                                  insType::PTR_MOV});
+    out.insert(out.end(), ins.begin() + resume, ins.end());
+    ins.swap(out);
+    return st.steps;
+}
+
+// Writes runs of output from several cells at once. Two or more PUT_CHRs in a row become a
+// PUT_STR that gathers the cells they name into one block write, or a WRITE_STR when every
+// cell is known to hold a constant at that point. Values are only followed within straight-line
+// code, and the cell a loop or skipped block tests is zero after it. Jumps are measured again
+// afterwards. Returns the number of runs merged.
+template <typename CellT>
+uint64_t coalesceOutput(std::vector<instruction>& ins) {
+    std::unordered_map<ptrdiff_t, CellT> known;  // by position relative to the block's start
+    ptrdiff_t ptr = 0;
+    auto forget = [&]() {
+        known.clear();
+        ptr = 0;
+    };
+    auto value = [&](ptrdiff_t at) -> const CellT* {
+        const auto it = known.find(at);
+        return it == known.end() ? nullptr : &it->second;
+    };
+    std::vector<instruction> out;
+    out.reserve(ins.size());
+    // Skipped blocks still open: their SKP_ZER in out, their last instruction in ins and the
+    // cell they test.
+    struct Block {
+        size_t start;
+        size_t last;
+        int16_t offset;
+    };
+    std::vector<Block> blocks;
+    auto closeBlocks = [&](size_t next) {
+        while (!blocks.empty() && blocks.back().last < next) {
+            const Block block = blocks.back();
+            blocks.pop_back();
+            out[block.start].data = static_cast<int32_t>(out.size() - 1 - block.start);
+            forget();
+            known[block.offset] = 0;
+        }
+    };
+    std::string literal;
+    uint64_t runs = 0;
+    for (size_t i = 0; i < ins.size(); ++i) {
+        closeBlocks(i);
+        const instruction& inst = ins[i];
+        const ptrdiff_t at = ptr + inst.offset;
+        switch (inst.op) {
+            case insType::WRITE_STR: {
+                const size_t end = i + 1 + strSlots(inst.data);
+                out.insert(out.end(), ins.begin() + i, ins.begin() + end);
+                i = end - 1;
+                continue;
+            }
+            case insType::PUT_CHR: {
+                const size_t limit = blocks.empty() ? ins.size() : blocks.back().last + 1;
+                size_t end = i + 1;
+                while (end < limit && ins[end].op == insType::PUT_CHR) ++end;
+                if (end - i < 2) break;
+                // Constant output is kept inline up to a few KiB.
+                literal.clear();
+                bool constant = true;
+                for (size_t k = i; k < end && constant; ++k) {
+                    const CellT* v = value(ptr + ins[k].offset);
+                    const size_t count = static_cast<size_t>(ins[k].data);
+                    constant = v && literal.size() + count <= 4096;
+                    if (constant) literal.append(count, static_cast<char>(*v));
+                }
+                if (constant) {
+                    appendWriteStr(out, literal);
+                } else {
+                    out.push_back(instruction{nullptr, static_cast<int32_t>(end - i), 0, 0,
+                                              insType::PUT_STR});
+                    out.insert(out.end(), ins.begin() + i, ins.begin() + end);
+                }
+                ++runs;
+                i = end - 1;
+                continue;
+            }
+            case insType::ADD_SUB:
+                if (const CellT* v = value(at))
+                    known[at] = static_cast<CellT>(*v + static_cast<CellT>(inst.data));
+                break;
+            case insType::SET:
+                known[at] = static_cast<CellT>(inst.data);
+                break;
+            case insType::CLR:
+                known[at] = 0;
+                break;
+            case insType::CLR_RNG:
+                for (int32_t k = 0; k < inst.data; ++k) known[at + k] = 0;
+                break;
+            case insType::RAD_CHR:
+                for (int32_t k = 0; k < inst.data; ++k) known.erase(at + k);
+                break;
+            case insType::MUL_CPY: {
+                const CellT* src = value(at);
+                const CellT* dst = value(at + inst.data);
+                if (src && dst)
+                    known[at + inst.data] = static_cast<CellT>(
+                        *dst + static_cast<CellT>(*src * static_cast<CellT>(inst.auxData)));
+                else
+                    known.erase(at + inst.data);
+                break;
+            }
+            case insType::STREAM_COPY:
+                known.erase(at);
+                break;
+            case insType::PTR_MOV:
+                ptr += inst.data;
+                break;
+            case insType::JMP_NOT_ZER:
+                forget();
+                known[inst.offset] = 0;
+                break;
+            case insType::SKP_ZER:  // what is known before a block holds inside it
+                blocks.push_back(
+                    Block{out.size(), i + static_cast<size_t>(inst.data), inst.offset});
+                break;
+            default:  // loops and scans leave the pointer and the cells unknown
+                forget();
+                break;
+        }
+        out.push_back(inst);
+    }
+    closeBlocks(ins.size());
+    if (!runs) return 0;
+    // Measure every loop again in the new sequence.
+    std::vector<size_t> open;
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (out[i].op == insType::WRITE_STR) {
+            i += strSlots(out[i].data);
+        } else if (out[i].op == insType::PUT_STR) {
+            i += static_cast<size_t>(out[i].data);
+        } else if (out[i].op == insType::JMP_ZER) {
+            open.push_back(i);
+        } else if (out[i].op == insType::JMP_NOT_ZER) {
+            const int32_t distance = static_cast<int32_t>(i - open.back());
+            out[open.back()].data = distance;
+            out[i].data = distance;
+            open.pop_back();
+        }
+    }
+    ins.swap(out);
+    return runs;
+}
+}  // namespace
+
+template <typename CellT, bool Dynamic, bool Term, bool Sparse>
+int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code,
+                goof2::OptLevel level, int eof, MemoryModel model, bool adaptive, size_t span,
+                goof2::ProfileInfo* profile, std::vector<instruction>* cached,
+                goof2::ForkedTape<CellT>* forked, const IoConfig& io, bool compileOnly,
+                goof2::CompileSession* session, goof2::OptReport* report) {
+    std::vector<instruction> localInstructions;
+    localInstructions.reserve(code.size());
+    auto* instructionsPtr = cached ? cached : &localInstructions;
+    bool hasInstructions = cached && !cached->empty();
+    auto& instructions = *instructionsPtr;
+    if (!hasInstructions) {
+        static void* jtable[] = {&&_ADD_SUB,     &&_SET,         &&_PTR_MOV, &&_JMP_ZER,
+                                 &&_JMP_NOT_ZER, &&_PUT_CHR,     &&_RAD_CHR, &&_CLR,
+                                 &&_CLR_RNG,     &&_MUL_CPY,     &&_SCN_RGT, &&_SCN_LFT,
+                                 &&_SCN_CLR_RGT, &&_SCN_CLR_LFT, &&_STREAM_COPY,
+                                 &&_WRITE_STR,   &&_PUT_STR,     &&_SKP_ZER,
+                                 &&_DIVMOD,      &&_MUL_PRD,     &&_END};
+
+        ChunkStats stats;
+        if (const int err = compileSource<CellT, Term>(code, level, eof, instructions, stats,
+                                                      session, report))
+            return err;
+        if (static_cast<size_t>(stats.maxPos - stats.minPos + 1) > span)
+            span = static_cast<size_t>(stats.maxPos - stats.minPos + 1);
+        if (profile) profile->heapBytes += stats.heapBytes;
+        // A fresh run starts on a zeroed tape; the REPL keeps its cells between lines.
+        if constexpr (!Term) {
+            if (level >= goof2::OptLevel::O2) {
+                StageTimer timer{report};
+                const uint64_t dropped = foldKnownTape<CellT>(instructions);
+                timer(&goof2::OptReport::tapeSeconds);
+                if (report) report->deadLoops += dropped;
+            }
+            const uint64_t budget = evalBudget.load(std::memory_order_relaxed);
+            if (level >= goof2::OptLevel::O3 && budget) {
+                StageTimer timer{report};
+                const uint64_t steps = bakePrefix<CellT>(instructions, budget);
+                timer(&goof2::OptReport::evalSeconds);
+                if (report) report->evalSteps += steps;
+            }
+        }
+        if (level >= goof2::OptLevel::O3) {
+            const uint64_t runs = coalesceOutput<CellT>(instructions);
+            if (report) report->outputRuns += runs;
+        }
+        instructions.push_back(instruction{nullptr, 0, 0, 0, insType::END});
+
+        instructions.shrink_to_fit();
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            instructions[i].jump = jtable[static_cast<size_t>(instructions[i].op)];
+            if (instructions[i].op == insType::WRITE_STR) i += strSlots(instructions[i].data);
+        }
+    }
+    if (compileOnly) return 0;
+    goof2::OutputBuffer out(io.flush, io.output,
+                            profile ? &profile->writerStallSeconds : nullptr);
+    goof2::InputBuffer input(io.input);
+
+    auto insp = instructions.data();
+    [[maybe_unused]] std::vector<std::pair<size_t, CellT>> sparseTape;
+    [[maybe_unused]] size_t sparseIndex = cellPtr;
+    [[maybe_unused]] size_t sparseMaxIndex = 0;
+    CellT* __restrict cellBase = cells.data();
+    CellT* __restrict cell = cellBase + cellPtr;
     size_t osSize = cells.size();
+    // How the current OS-backed region is released and whether it may be grown in place.
+    [[maybe_unused]] void (*tapeFree)(void*, size_t) = nullptr;
+    [[maybe_unused]] bool tapeRemap = false;
+    if (forked) {
+        cellBase = forked->data;
+        cell = cellBase + cellPtr;
+        osSize = forked->size;
+        tapeFree = forked->release;
+    }
+    // Hand the (possibly moved) mapping back to the fork on every exit path.
+    ScopeExit syncFork{[&] {
+        if (!forked) return;
+        if (model == MemoryModel::OSBacked) {
+            forked->data = cellBase;
+            forked->size = osSize;
+            forked->release = tapeFree;
+        } else {
+            forked->data = cells.data();
+            forked->size = cells.size();
+            forked->release = nullptr;
+        }
+    }};
+    auto tapeSize = [&]() { return model == MemoryModel::OSBacked ? osSize : cells.size(); };
     if constexpr (Sparse) {
 #if defined(SIMDE_X86_AVX2_NATIVE) || (SIMDE_NATURAL_VECTOR_SIZE >= 256)
         size_t i = 0;
@@ -1619,7 +3169,7 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
     }
     if constexpr (!Sparse) {
 #if GOOF2_HAS_OS_VM
-        if (model == MemoryModel::OSBacked) {
+        if (model == MemoryModel::OSBacked && !forked) {
             void* ptr = goof2::os_alloc(osSize * sizeof(CellT));
 #ifdef _WIN32
             if (ptr)
@@ -1631,6 +3181,8 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
                 std::memcpy(osMem, cellBase, osSize * sizeof(CellT));
                 cellBase = osMem;
                 cell = cellBase + cellPtr;
+                tapeFree = goof2::os_free;
+                tapeRemap = goof2::os_alloc == &goof2::defaultOsAlloc;
             } else {
                 std::cerr << "warning: OS-backed allocation failed, falling back to contiguous "
                              "memory model"
@@ -1674,16 +3226,16 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
 #endif
                 if (ok) {
                     CellT* newMem = static_cast<CellT*>(nptr);
-                    std::memcpy(
-                        newMem, cellBase,
-                        (model == MemoryModel::OSBacked ? osSize : cells.size()) * sizeof(CellT));
+                    std::memcpy(newMem, cellBase, tapeSize() * sizeof(CellT));
                     if (model == MemoryModel::OSBacked) {
-                        goof2::os_free(cellBase, osSize * sizeof(CellT));
+                        tapeFree(cellBase, osSize * sizeof(CellT));
                     } else {
                         std::vector<CellT>().swap(cells);
                     }
                     cellBase = newMem;
                     osSize = newSize;
+                    tapeFree = goof2::os_free;
+                    tapeRemap = goof2::os_alloc == &goof2::defaultOsAlloc;
                     model = MemoryModel::OSBacked;
                     fibA = fibB = osSize;
                 } else {
@@ -1698,7 +3250,7 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
                     size_t oldSize = osSize;
                     cells.resize(oldSize);
                     std::memcpy(cells.data(), cellBase, oldSize * sizeof(CellT));
-                    goof2::os_free(cellBase, osSize * sizeof(CellT));
+                    tapeFree(cellBase, osSize * sizeof(CellT));
                     cellBase = cells.data();
                 }
                 model = target;
@@ -1711,22 +3263,28 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
                 size_t newSize = ((needed + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
                 if (newSize > osSize) {
                     bool resized = false;
+                    // Only regions from the default allocator can be grown in place; custom
+                    // allocators and copy-on-write views take the allocate-and-copy path.
 #if defined(__linux__)
-                    void* mptr = mremap(cellBase, osSize * sizeof(CellT), newSize * sizeof(CellT),
-                                        MREMAP_MAYMOVE);
-                    if (mptr != MAP_FAILED) {
-                        cellBase = static_cast<CellT*>(mptr);
-                        osSize = newSize;
-                        resized = true;
+                    if (tapeRemap) {
+                        void* mptr = mremap(cellBase, osSize * sizeof(CellT),
+                                            newSize * sizeof(CellT), MREMAP_MAYMOVE);
+                        if (mptr != MAP_FAILED) {
+                            cellBase = static_cast<CellT*>(mptr);
+                            osSize = newSize;
+                            resized = true;
+                        }
                     }
 #elif defined(_WIN32)
-                    auto basePtr = reinterpret_cast<uint8_t*>(cellBase);
-                    void* mptr = VirtualAlloc(basePtr + osSize * sizeof(CellT),
-                                              (newSize - osSize) * sizeof(CellT), MEM_COMMIT,
-                                              PAGE_READWRITE);
-                    if (mptr) {
-                        osSize = newSize;
-                        resized = true;
+                    if (tapeRemap) {
+                        auto basePtr = reinterpret_cast<uint8_t*>(cellBase);
+                        void* mptr = VirtualAlloc(basePtr + osSize * sizeof(CellT),
+                                                  (newSize - osSize) * sizeof(CellT), MEM_COMMIT,
+                                                  PAGE_READWRITE);
+                        if (mptr) {
+                            osSize = newSize;
+                            resized = true;
+                        }
                     }
 #endif
                     if (!resized) {
@@ -1738,10 +3296,26 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
 #endif
                         if (ok) {
                             CellT* newMem = static_cast<CellT*>(nptr);
-                            std::memcpy(newMem, cellBase, osSize * sizeof(CellT));
-                            goof2::os_free(cellBase, osSize * sizeof(CellT));
+                            bool moved = false;
+#if defined(__linux__)
+                            // Move a forked view's pages into the new region instead of copying
+                            // them so untouched pages stay shared with the snapshot.
+                            if (tapeFree == &goof2::TapeImage::unmap &&
+                                goof2::os_alloc == &goof2::defaultOsAlloc) {
+                                moved = mremap(cellBase, osSize * sizeof(CellT),
+                                               osSize * sizeof(CellT),
+                                               MREMAP_MAYMOVE | MREMAP_FIXED,
+                                               newMem) != MAP_FAILED;
+                            }
+#endif
+                            if (!moved) {
+                                std::memcpy(newMem, cellBase, osSize * sizeof(CellT));
+                                tapeFree(cellBase, osSize * sizeof(CellT));
+                            }
                             cellBase = newMem;
                             osSize = newSize;
+                            tapeFree = goof2::os_free;
+                            tapeRemap = goof2::os_alloc == &goof2::defaultOsAlloc;
                         } else {
                             std::cerr << "warning: OS-backed allocation failed, falling back to "
                                          "contiguous "
@@ -1749,7 +3323,7 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
                                       << std::endl;
                             cells.resize(newSize);
                             std::memcpy(cells.data(), cellBase, osSize * sizeof(CellT));
-                            goof2::os_free(cellBase, osSize * sizeof(CellT));
+                            tapeFree(cellBase, osSize * sizeof(CellT));
                             cellBase = cells.data();
                             osSize = cells.size();
                             model = MemoryModel::Contiguous;
@@ -1801,18 +3375,21 @@ int executeImpl(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, b
         }
     };
 
+    // Set when the run stops at profile->instructionLimit; it leaves through _END all the same.
+    bool limited = false;
     goto * insp->jump;
 
-#define LOOP()                            \
-    insp++;                               \
-    if (profile) ++profile->instructions; \
+#define LOOP()                                                                        \
+    insp++;                                                                           \
+    if (profile && ++profile->instructions == profile->instructionLimit) [[unlikely]] \
+        goto _LIMIT;                                                                  \
     goto * insp->jump
 #define EXPAND_IF_NEEDED()                                                               \
     if constexpr (!Sparse) {                                                             \
         if (insp->offset > 0) {                                                          \
             const ptrdiff_t currentCell = cell - cellBase;                               \
             const ptrdiff_t neededIndex = currentCell + insp->offset;                    \
-            size_t totalSize = (model == MemoryModel::OSBacked ? osSize : cells.size()); \
+            size_t totalSize = tapeSize();                                               \
             size_t needed = static_cast<size_t>(neededIndex + 1);                        \
             if (needed > totalSize || (adaptive && needed > span)) {                     \
                 ensure(currentCell, neededIndex);                                        \
@@ -1851,10 +3428,10 @@ _PTR_MOV: {
             return -1;
         }
         size_t needed = static_cast<size_t>(newIndex + 1);
-        if (newIndex >= static_cast<ptrdiff_t>(cells.size()) || (adaptive && needed > span)) {
+        if (newIndex >= static_cast<ptrdiff_t>(tapeSize()) || (adaptive && needed > span)) {
             if constexpr (Dynamic) {
                 ensure(currentCell, newIndex);
-            } else if (newIndex >= static_cast<ptrdiff_t>(cells.size())) {
+            } else if (newIndex >= static_cast<ptrdiff_t>(tapeSize())) {
                 cellPtr = currentCell;
                 std::cerr << "cell pointer moved beyond end" << std::endl;
                 return -1;
@@ -1866,50 +3443,114 @@ _PTR_MOV: {
 }
 
 _JMP_ZER:
-    if (!cellRef(0)) [[unlikely]]
+    if constexpr (Dynamic) EXPAND_IF_NEEDED()
+    if (!OFFCELL()) [[unlikely]]
         insp += insp->data;
     LOOP();
 
 _JMP_NOT_ZER:
-    if (cellRef(0)) [[likely]]
+    if (OFFCELL()) [[likely]]
         insp -= insp->data;
     LOOP();
 
+_SKP_ZER:
+    if constexpr (Dynamic) EXPAND_IF_NEEDED()
+    if (!OFFCELL()) insp += insp->data;
+    LOOP();
+
+_DIVMOD: {
+    if constexpr (Dynamic && !Sparse) {
+        const ptrdiff_t currentCell = cell - cellBase;
+        const ptrdiff_t neededIndex = currentCell + insp->offset + 6;
+        size_t needed = static_cast<size_t>(neededIndex + 1);
+        if (needed > tapeSize() || (adaptive && needed > span)) ensure(currentCell, neededIndex);
+    }
+    const ptrdiff_t at = insp->offset;
+    const CellT n = cellRef(at);
+    const CellT d = cellRef(at + 2);
+    if (n && d != 1 && !cellRef(at + 3) && !cellRef(at + 5) && !cellRef(at + 6)) {
+        // The loop takes a divisor of zero as one that never divides.
+        const CellT rem = d ? static_cast<CellT>(n % d) : n;
+        const CellT quot = d ? static_cast<CellT>(n / d) : CellT(0);
+        cellRef(at) = 0;
+        cellRef(at + 1) += n;
+        cellRef(at + 2) = static_cast<CellT>(d - rem);
+        cellRef(at + 3) = rem;
+        cellRef(at + 4) += quot;
+    }
+    LOOP();
+}
+
+_MUL_PRD: {
+    const ptrdiff_t at = insp->offset;
+    const ptrdiff_t to = at + static_cast<int16_t>(insp->data);
+    const ptrdiff_t from = at + (insp->data >> 16);
+    if constexpr (Dynamic && !Sparse) {
+        const ptrdiff_t currentCell = cell - cellBase;
+        const ptrdiff_t neededIndex = currentCell + std::max({at, to, from});
+        size_t needed = static_cast<size_t>(neededIndex + 1);
+        if (needed > tapeSize() || (adaptive && needed > span)) ensure(currentCell, neededIndex);
+    }
+    cellRef(to) += static_cast<CellT>(static_cast<uint64_t>(cellRef(at)) * cellRef(from) *
+                                      static_cast<CellT>(insp->auxData));
+    LOOP();
+}
+
 _PUT_CHR:
     if (size_t count = static_cast<size_t>(insp->data); count) {
-        const char ch = static_cast<char>(OFFCELL());
-        char buf[256];
-        std::memset(buf, static_cast<int>(ch), sizeof(buf));
-        while (count >= sizeof(buf)) {
-            std::cout.write(buf, sizeof(buf));
-            count -= sizeof(buf);
-        }
-        if (count) {
-            std::cout.write(buf, count);
-        }
-        std::cout.flush();
+        out.put(static_cast<char>(OFFCELL()), count);
     }
     LOOP();
 
 _RAD_CHR:
-    if constexpr (Dynamic) EXPAND_IF_NEEDED()
-    int in;
-    in = std::cin.get();
-    if (in == EOF) {
-        switch (eof) {
-            case 0:
-                break;
-            case 1:
-                OFFCELL() = 0;
-                break;
-            case 2:
-                OFFCELL() = static_cast<CellT>(255);
-                break;
-            default:
-                __builtin_unreachable();
+    if constexpr (Dynamic) {
+        if constexpr (!Sparse) {
+            ptrdiff_t maxOffset = insp->offset + insp->data - 1;
+            if (maxOffset > 0) {
+                const ptrdiff_t currentCell = cell - cellBase;
+                const ptrdiff_t neededIndex = currentCell + maxOffset;
+                size_t totalSize = tapeSize();
+                size_t needed = static_cast<size_t>(neededIndex + 1);
+                if (needed > totalSize || (adaptive && needed > span)) {
+                    ensure(currentCell, neededIndex);
+                }
+            }
+        }
+    }
+    out.beforeInput();
+    {
+        int32_t got;
+        if constexpr (Sparse) {
+            for (got = 0; got < insp->data; ++got) {
+                const int in = input.get();
+                if (in == EOF) break;
+                cellRef(insp->offset + got) = static_cast<CellT>(in);
+            }
+        } else {
+            if (insp->data == 1) [[likely]] {
+                const int in = input.get();
+                got = in != EOF;
+                if (got) OFFCELL() = static_cast<CellT>(in);
+            } else {
+                got = static_cast<int32_t>(
+                    input.read(cell + insp->offset, static_cast<size_t>(insp->data)));
+            }
+        }
+        // Every read past the end of input gets the EOF behaviour.
+        for (; got < insp->data; ++got) {
+            switch (eof) {
+                case 0:
+                    break;
+                case 1:
+                    cellRef(insp->offset + got) = 0;
+                    break;
+                case 2:
+                    cellRef(insp->offset + got) = static_cast<CellT>(255);
+                    break;
+                default:
+                    __builtin_unreachable();
+            }
         }
-    } else {
-        OFFCELL() = static_cast<CellT>(in);
     }
     LOOP();
 
@@ -1926,7 +3567,7 @@ _CLR_RNG:
                 if (maxOffset > 0) {
                     const ptrdiff_t currentCell = cell - cellBase;
                     const ptrdiff_t neededIndex = currentCell + maxOffset;
-                    size_t totalSize = (model == MemoryModel::OSBacked ? osSize : cells.size());
+                    size_t totalSize = tapeSize();
                     size_t needed = static_cast<size_t>(neededIndex + 1);
                     if (needed > totalSize || (adaptive && needed > span)) {
                         ensure(currentCell, neededIndex);
@@ -1954,7 +3595,7 @@ _MUL_CPY:
         const ptrdiff_t currentCell = cell - cellBase;
         const ptrdiff_t neededIndex =
             currentCell + insp->offset + insp->data;  // ensure target exists
-        size_t totalSize = (model == MemoryModel::OSBacked ? osSize : cells.size());
+        size_t totalSize = tapeSize();
         size_t needed = static_cast<size_t>(neededIndex + 1);
         if (needed > totalSize || (adaptive && needed > span)) {
             ensure(currentCell, neededIndex);
@@ -1978,7 +3619,7 @@ _MUL_CPY:
                 const ptrdiff_t currentCell = cell - cellBase;
                 const ptrdiff_t neededIndex =
                     currentCell + base[lanes - 1].offset + base[lanes - 1].data;
-                size_t totalSize = (model == MemoryModel::OSBacked ? osSize : cells.size());
+                size_t totalSize = tapeSize();
                 size_t needed = static_cast<size_t>(neededIndex + 1);
                 if (needed > totalSize || (adaptive && needed > span)) {
                     ensure(currentCell, neededIndex);
@@ -1996,8 +3637,10 @@ _MUL_CPY:
                 simde__m256i prod = simde_mm256_mullo_epi16(srcv, facv);
                 simde__m256i sum = simde_mm256_add_epi16(dstv, prod);
                 sum = simde_mm256_and_si256(sum, simde_mm256_set1_epi16(0xFF));
-                simde__m256i packed = simde_mm256_packus_epi16(sum, simde_mm256_setzero_si256());
-                simde_mm_storeu_si128((simde__m128i*)dst, simde_mm256_castsi256_si128(packed));
+                // packus works per 128-bit lane, so pack the two halves against each other.
+                simde__m128i packed = simde_mm_packus_epi16(simde_mm256_castsi256_si128(sum),
+                                                            simde_mm256_extracti128_si256(sum, 1));
+                simde_mm_storeu_si128((simde__m128i*)dst, packed);
             } else if constexpr (std::is_same_v<CellT, uint16_t>) {
                 simde__m256i dstv = simde_mm256_loadu_si256((const simde__m256i*)dst);
                 simde__m256i srcv = simde_mm256_set1_epi16(src);
@@ -2048,7 +3691,7 @@ _SCN_RGT: {
 
     // small pre-grow to cut resize churn during long scans
     if constexpr (Dynamic) {
-        while ((cell - cellBase) + 64 >= static_cast<ptrdiff_t>(cells.size()) ||
+        while ((cell - cellBase) + 64 >= static_cast<ptrdiff_t>(tapeSize()) ||
                (adaptive && static_cast<size_t>((cell - cellBase) + 65) > span)) {
             const ptrdiff_t rel = cell - cellBase;
             ensure(rel, rel + 64);
@@ -2056,7 +3699,7 @@ _SCN_RGT: {
     }
 
     for (;;) {
-        CellT* const end = cellBase + cells.size();
+        CellT* const end = cellBase + tapeSize();
         size_t off;
         if (step == 1) {
             off = simdScan0FwdFn<CellT>(cell, end);
@@ -2226,7 +3869,7 @@ _SCN_CLR_RGT: {
     }
 
     if constexpr (Dynamic) {
-        while ((cell - cellBase) + 64 >= static_cast<ptrdiff_t>(cells.size()) ||
+        while ((cell - cellBase) + 64 >= static_cast<ptrdiff_t>(tapeSize()) ||
                (adaptive && static_cast<size_t>((cell - cellBase) + 65) > span)) {
             const ptrdiff_t rel = cell - cellBase;
             ensure(rel, rel + 64);
@@ -2235,7 +3878,7 @@ _SCN_CLR_RGT: {
 
     if (step == 1) {
         for (;;) {
-            CellT* end = cellBase + cells.size();
+            CellT* end = cellBase + tapeSize();
             size_t off = simdScan0FwdFn<CellT>(cell, end);
             if (off == 0) {
                 LOOP();
@@ -2270,14 +3913,14 @@ _SCN_CLR_RGT: {
                 const ptrdiff_t rel = cell - cellBase;
                 ensure(rel, rel);
             }
-            if (cell < cellBase + cells.size()) {
+            if (cell < cellBase + tapeSize()) {
                 continue;
             }
             if constexpr (Dynamic) {
                 const ptrdiff_t rel = cell - cellBase;
                 ensure(rel, rel);
             } else {
-                cell = cellBase + cells.size() - 1;
+                cell = cellBase + tapeSize() - 1;
                 cellPtr = cell - cellBase;
                 std::cerr << "cell pointer moved beyond end" << std::endl;
                 return -1;
@@ -2290,13 +3933,13 @@ _SCN_CLR_LFT: {
     const unsigned step = static_cast<unsigned>(insp->data);
     if constexpr (Sparse) {
         while (cellRef(0) != 0) {
+            cellRef(0) = 0;
             if (sparseIndex < step) {
                 cellPtr = 0;
                 std::cerr << "cell pointer moved before start" << std::endl;
                 return -1;
             }
             sparseIndex -= step;
-            cellRef(0) = 0;
         }
         LOOP();
     }
@@ -2305,16 +3948,98 @@ _SCN_CLR_LFT: {
         if (*cell == 0) {
             LOOP();
         }
+        *cell = 0;
         if (cell - cellBase < static_cast<ptrdiff_t>(step)) {
             cellPtr = 0;
             std::cerr << "cell pointer moved before start" << std::endl;
             return -1;
         }
         cell -= step;
-        *cell = 0;
     }
 }
 
+_PUT_STR: {
+    // The PUT_CHRs after it name the cells; gather them and write them as one block.
+    char gathered[256];
+    size_t len = 0;
+    const instruction* entry = insp + 1;
+    for (int32_t k = 0; k < insp->data; ++k, ++entry) {
+        const char ch = static_cast<char>(cellRef(entry->offset));
+        for (int32_t r = 0; r < entry->data; ++r) {
+            if (len == sizeof(gathered)) {
+                out.putBlock(gathered, len);
+                len = 0;
+            }
+            gathered[len++] = ch;
+        }
+    }
+    out.putBlock(gathered, len);
+    insp += insp->data;
+    LOOP();
+}
+
+_WRITE_STR:
+    out.putBlock(reinterpret_cast<const char*>(insp + 1), static_cast<size_t>(insp->data));
+    insp += strSlots(insp->data);
+    LOOP();
+
+_STREAM_COPY: {
+    // A pass-through loop: while the cell is nonzero, print it (less the bias) and read the next
+    // byte. Input is scanned a buffered block at a time for the byte that ends the loop.
+    if constexpr (Dynamic) EXPAND_IF_NEEDED()
+    CellT& c = OFFCELL();
+    const CellT bias = static_cast<CellT>(insp->data);
+    const CellT stop = static_cast<CellT>(CellT(0) - bias);
+    const bool stopIsByte = stop <= 0xFF;
+    while (c) {
+        CellT last = static_cast<CellT>(c - bias);
+        out.put(static_cast<char>(last), 1);
+        bool stopped = false;
+        for (;;) {
+            out.beforeInput();
+            const std::string_view avail = input.available();
+            if (avail.empty()) break;
+            const void* hit = stopIsByte ? std::memchr(avail.data(), static_cast<int>(stop),
+                                                       avail.size())
+                                         : nullptr;
+            const size_t n = hit ? static_cast<size_t>(static_cast<const char*>(hit) -
+                                                       avail.data())
+                                 : avail.size();
+            if (n) {
+                out.putBlock(avail.data(), n);
+                last = static_cast<unsigned char>(avail[n - 1]);
+            }
+            input.skip(hit ? n + 1 : n);
+            if (hit) {
+                stopped = true;
+                break;
+            }
+        }
+        if (stopped) {
+            c = 0;
+            break;
+        }
+        // End of input: the cell gets the EOF value, and the loop carries on as written.
+        switch (eof) {
+            case 0:
+                c = static_cast<CellT>((insp->auxData ? stop : last) + bias);
+                break;
+            case 1:
+                c = bias;
+                break;
+            case 2:
+                c = static_cast<CellT>(255 + bias);
+                break;
+            default:
+                __builtin_unreachable();
+        }
+    }
+    LOOP();
+}
+
+_LIMIT:
+    std::cerr << "instruction limit reached" << std::endl;
+    limited = true;
 _END: {
     ptrdiff_t finalIndex;
     if constexpr (Sparse) {
@@ -2335,16 +4060,16 @@ _END: {
     } else {
         finalIndex = cell - cellBase;
 #if GOOF2_HAS_OS_VM
-        if (model == MemoryModel::OSBacked && cellBase != cells.data()) {
+        if (model == MemoryModel::OSBacked && cellBase != cells.data() && !forked) {
             cells.assign(cellBase, cellBase + osSize);
-            goof2::os_free(cellBase, osSize * sizeof(CellT));
+            tapeFree(cellBase, osSize * sizeof(CellT));
             cellBase = cells.data();
         }
 #endif
     }
     cellPtr = finalIndex;
 }
-    return 0;
+    return limited ? -1 : 0;
 }
 
 struct SpanInfo {
@@ -2368,13 +4093,74 @@ static SpanInfo analyzeSpan(std::string_view code) {
     return {sparse, span};
 }
 
+// Whether every cell is still zero, as the passes that are off with term assume.
+template <typename CellT>
+static bool tapeIsZero(const std::vector<CellT>& cells) {
+    constexpr size_t block = 4096 / sizeof(CellT);
+    for (size_t i = 0; i < cells.size(); i += block) {
+        const size_t end = std::min(cells.size(), i + block);
+        CellT any = 0;
+        for (size_t k = i; k < end; ++k) any |= cells[k];
+        if (any) return false;
+    }
+    return true;
+}
+
+// Level for OptLevel::Auto. Steps are estimated by counting every command once per assumed
+// iteration of the loops around it, taking each loop to turn 16 times. Sources without loops
+// only need folding; otherwise the more steps per source byte, the more compile time pays for
+// itself, and runs that are short outright stay on the cheap levels.
+static goof2::OptLevel autoOptLevel(std::string_view code) {
+    constexpr uint64_t cap = uint64_t(1) << 62;
+    uint64_t steps = 0;
+    int depth = 0;
+    bool loops = false;
+    for (char c : code) {
+        switch (c) {
+            case '[':
+                ++depth;
+                loops = true;
+                break;
+            case ']':
+                --depth;
+                break;
+            case '+':
+            case '-':
+            case '>':
+            case '<':
+            case '.':
+            case ',':
+                break;
+            default:
+                continue;
+        }
+        const uint64_t weight =
+            depth >= 15 ? uint64_t(1) << 60 : uint64_t(1) << (4 * std::max(depth, 0));
+        steps = steps > cap - weight ? cap : steps + weight;
+    }
+    if (!loops) return goof2::OptLevel::O0;
+    const uint64_t perByte = steps / std::max<size_t>(code.size(), 1);
+    goof2::OptLevel level = perByte < 64     ? goof2::OptLevel::O1
+                            : perByte < 4096 ? goof2::OptLevel::O2
+                                             : goof2::OptLevel::O3;
+    if (steps < (uint64_t(1) << 16))
+        level = std::min(level, goof2::OptLevel::O1);
+    else if (steps < (uint64_t(1) << 22))
+        level = std::min(level, goof2::OptLevel::O2);
+    return level;
+}
+
 template <typename CellT>
 int executeDispatch(bool dynamicSize, bool sparse, bool term, std::vector<CellT>& cells,
-                    size_t& cellPtr, std::string& code, bool optimize, int eof, MemoryModel model,
-                    bool adaptive, size_t span, goof2::ProfileInfo* profile,
-                    std::vector<instruction>* cached) {
-    using Fn = int (*)(std::vector<CellT>&, size_t&, std::string&, bool, int, MemoryModel, bool,
-                       size_t, goof2::ProfileInfo*, std::vector<instruction>*);
+                    size_t& cellPtr, std::string& code, goof2::OptLevel level, int eof,
+                    MemoryModel model, bool adaptive, size_t span, goof2::ProfileInfo* profile,
+                    std::vector<instruction>* cached, goof2::ForkedTape<CellT>* forked,
+                    const IoConfig& io, bool compileOnly, goof2::CompileSession* session,
+                    goof2::OptReport* report) {
+    using Fn = int (*)(std::vector<CellT>&, size_t&, std::string&, goof2::OptLevel, int,
+                       MemoryModel, bool, size_t, goof2::ProfileInfo*, std::vector<instruction>*,
+                       goof2::ForkedTape<CellT>*, const IoConfig&, bool, goof2::CompileSession*,
+                       goof2::OptReport*);
     static constexpr std::array<Fn, 8> table{{
         &executeImpl<CellT, false, false, false>,
         &executeImpl<CellT, false, true, false>,
@@ -2387,63 +4173,38 @@ int executeDispatch(bool dynamicSize, bool sparse, bool term, std::vector<CellT>
     }};
     unsigned idx = (static_cast<unsigned>(dynamicSize) << 2) |
                    (static_cast<unsigned>(sparse) << 1) | static_cast<unsigned>(term);
-    return table[idx](cells, cellPtr, code, optimize, eof, model, adaptive, span, profile, cached);
+    return table[idx](cells, cellPtr, code, level, eof, model, adaptive, span, profile, cached,
+                      forked, io, compileOnly, session, report);
 }
 
 template <typename CellT>
-int goof2::execute(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, bool optimize,
-                   int eof, bool dynamicSize, bool term, MemoryModel model, ProfileInfo* profile,
-                   InstructionCache* cache) {
+static int executeCached(std::vector<CellT>& cells, size_t& cellPtr, std::string& code,
+                         bool optimize, int eof, bool dynamicSize, bool term, MemoryModel model,
+                         goof2::ProfileInfo* profile, goof2::InstructionCache* cache,
+                         goof2::ForkedTape<CellT>* forked, const IoConfig& io,
+                         bool compileOnly = false, goof2::CompileSession* session = nullptr,
+                         goof2::OptReport* report = nullptr) {
     int ret = 0;
     std::chrono::steady_clock::time_point start;
     if (profile) {
         profile->instructions = 0;
+        profile->writerStallSeconds = 0.0;
         start = std::chrono::steady_clock::now();
     }
     SpanInfo spanInfo = analyzeSpan(code);
-    bool sparse = spanInfo.sparse;
-    size_t key = 0;
-    std::vector<instruction>* cacheVec = nullptr;
-    std::unique_lock<std::mutex> cacheLock;
-    if (cache) {
-        cacheLock = std::unique_lock<std::mutex>(cacheMutex);
-        if (cache->empty()) {
-            cache->reserve(kCacheExpectedEntries);
-            cacheUsage.clear();
-        }
-        key = std::hash<std::string>{}(code);
-        key ^= static_cast<size_t>(optimize) << 1;
-        key ^= static_cast<size_t>(term) << 2;
-        auto it = cache->find(key);
-        if (it != cache->end() && it->second.source == code) {
-            cacheVec = &it->second.instructions;
-            cacheUsage.splice(cacheUsage.begin(), cacheUsage, it->second.usageIter);
-            sparse = it->second.sparse;
-            cacheLock.unlock();
-        } else {
-            if (it == cache->end()) {
-                auto [newIt, inserted] = cache->emplace(key, CacheEntry{});
-                it = newIt;
-                cacheUsage.push_front(key);
-                it->second.usageIter = cacheUsage.begin();
-            } else {
-                cacheUsage.splice(cacheUsage.begin(), cacheUsage, it->second.usageIter);
-            }
-            auto& entry = it->second;
-            entry.source = code;
-            entry.instructions.clear();
-            entry.sparse = sparse;
-            cacheVec = &entry.instructions;
-            if (cache->size() > kCacheMaxEntries) {
-                size_t victimKey = cacheUsage.back();
-                cache->erase(victimKey);
-                cacheUsage.pop_back();
-            }
-        }
+    // A tape handed in with values in it is compiled for as if it were kept between runs.
+    if (!term && !forked && !tapeIsZero(cells)) term = true;
+    goof2::OptLevel level = goof2::OptLevel::O0;
+    if (optimize) {
+        level = optLevel.load(std::memory_order_relaxed);
+        if (level == goof2::OptLevel::Auto) level = autoOptLevel(code);
     }
+    // A forked tape is always run in place on its copy-on-write view.
+    bool sparse = spanInfo.sparse && !forked;
     bool adaptive = (model == MemoryModel::Auto);
     if (adaptive) model = MemoryModel::Contiguous;
-    size_t predictedSpan = std::max(spanInfo.span, cells.size());
+    if (forked) adaptive = false;
+    size_t predictedSpan = std::max(spanInfo.span, forked ? forked->size : cells.size());
     // Heuristic: choose model based on predicted bytes to keep memory usage low.
     if (dynamicSize && adaptive) {
         const size_t predictedBytes = predictedSpan * sizeof(CellT);
@@ -2457,28 +4218,200 @@ int goof2::execute(std::vector<CellT>& cells, size_t& cellPtr, std::string& code
         else if (predictedBytes > (size_t(1) << 20))
             model = MemoryModel::Fibonacci;
     }
-    if (dynamicSize && !sparse &&
+    if (dynamicSize && !sparse && !forked &&
         (model == MemoryModel::Contiguous || model == MemoryModel::Fibonacci)) {
         cells.reserve(predictedSpan);
     }
-    ret = executeDispatch<CellT>(dynamicSize, sparse, term, cells, cellPtr, code, optimize, eof,
-                                 model, adaptive, predictedSpan, profile, cacheVec);
-    if (cacheLock.owns_lock()) cacheLock.unlock();
+    // Cached programs are shared between threads, so a run holds its own reference and the lock
+    // is only taken for lookups and inserts. Two runs missing on the same program both compile
+    // it and the later one replaces the entry.
+    std::shared_ptr<std::vector<instruction>> cached;
+    if (cache) {
+        size_t key = std::hash<std::string>{}(code);
+        key ^= static_cast<size_t>(level) << 11;
+        key ^= static_cast<size_t>(term) << 2;
+        // Cached jump targets belong to one executeImpl instantiation.
+        key ^= static_cast<size_t>(dynamicSize) << 3;
+        key ^= static_cast<size_t>(sparse) << 4;
+        key ^= sizeof(CellT) << 5;
+        // Reads only fold away writes when EOF overwrites the cell.
+        key ^= static_cast<size_t>(eof) << 9;
+        key ^= static_cast<size_t>(idiomsKey.load(std::memory_order_relaxed));
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (cache->empty()) {
+                cache->reserve(kCacheExpectedEntries);
+                cacheUsage.clear();
+            }
+            auto it = cache->find(key);
+            if (it != cache->end() && it->second.source == code) {
+                cached = it->second.instructions;
+                cacheUsage.splice(cacheUsage.begin(), cacheUsage, it->second.usageIter);
+            }
+        }
+        if (!cached) {
+            auto fresh = std::make_shared<std::vector<instruction>>();
+            std::string source = code;
+            ret = executeDispatch<CellT>(dynamicSize, sparse, term, cells, cellPtr, code, level,
+                                         eof, model, adaptive, predictedSpan, profile, fresh.get(),
+                                         forked, io, true, session, report);
+            if (ret != 0) return ret;
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = cache->find(key);
+            if (it == cache->end()) {
+                it = cache->emplace(key, goof2::CacheEntry{}).first;
+                cacheUsage.push_front(key);
+                it->second.usageIter = cacheUsage.begin();
+            } else {
+                cacheUsage.splice(cacheUsage.begin(), cacheUsage, it->second.usageIter);
+            }
+            it->second.source = std::move(source);
+            it->second.instructions = fresh;
+            it->second.sparse = sparse;
+            if (cache->size() > kCacheMaxEntries) {
+                cache->erase(cacheUsage.back());
+                cacheUsage.pop_back();
+            }
+            cached = std::move(fresh);
+        }
+    }
+    ret = executeDispatch<CellT>(dynamicSize, sparse, term, cells, cellPtr, code, level, eof,
+                                 model, adaptive, predictedSpan, profile, cached.get(), forked, io,
+                                 compileOnly, session, report);
     if (profile)
         profile->seconds =
             std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     return ret;
 }
 
-template int goof2::execute<uint8_t>(std::vector<uint8_t>&, size_t&, std::string&, bool, int, bool,
-                                     bool, goof2::MemoryModel, goof2::ProfileInfo*,
-                                     goof2::InstructionCache*);
+template <typename CellT>
+int goof2::execute(std::vector<CellT>& cells, size_t& cellPtr, std::string& code, bool optimize,
+                   int eof, bool dynamicSize, bool term, MemoryModel model, ProfileInfo* profile,
+                   InstructionCache* cache, FlushPolicy flush, IoSource* input,
+                   IoSink* output) {
+    return executeCached<CellT>(cells, cellPtr, code, optimize, eof, dynamicSize, term, model,
+                                profile, cache, nullptr, IoConfig{flush, input, output});
+}
+
+template <typename CellT>
+int goof2::execute(std::vector<CellT>& cells, size_t& cellPtr, std::string& code,
+                   CompileSession& session, bool optimize, int eof, bool dynamicSize, bool term,
+                   MemoryModel model, ProfileInfo* profile, FlushPolicy flush, IoSource* input,
+                   IoSink* output) {
+    return executeCached<CellT>(cells, cellPtr, code, optimize, eof, dynamicSize, term, model,
+                                profile, &session.programs, nullptr,
+                                IoConfig{flush, input, output}, false, &session);
+}
+
+void goof2::setSliceSize(std::size_t bytes) {
+    sliceSize.store(std::max<std::size_t>(bytes, 1), std::memory_order_relaxed);
+}
+
+void goof2::setOptLevel(OptLevel level) { optLevel.store(level, std::memory_order_relaxed); }
+
+void goof2::setEvalBudget(std::uint64_t steps) {
+    evalBudget.store(steps, std::memory_order_relaxed);
+}
+
+bool goof2::loadIdioms(const std::string& path, std::string& err) {
+    std::string text;
+    if (!path.empty()) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            err = "Idiom file could not be opened";
+            return false;
+        }
+        std::ostringstream buf;
+        buf << in.rdbuf();
+        text = buf.str();
+    }
+    std::vector<Idiom> idioms;
+    if (!parseIdioms(text, idioms, err)) return false;
+    std::lock_guard<std::mutex> lock(idiomMutex);
+    userIdioms = std::make_shared<const std::vector<Idiom>>(std::move(idioms));
+    idiomsKey.store(text.empty() ? 0 : XXH3_64bits(text.data(), text.size()),
+                    std::memory_order_relaxed);
+    return true;
+}
+
+template <typename CellT>
+int goof2::compile(std::string& code, InstructionCache& cache, bool optimize, int eof,
+                   bool dynamicSize, bool term, OptReport* report) {
+    std::vector<CellT> cells;
+    size_t cellPtr = 0;
+    return executeCached<CellT>(cells, cellPtr, code, optimize, eof, dynamicSize, term,
+                                MemoryModel::Auto, nullptr, &cache, nullptr,
+                                IoConfig{FlushPolicy::Auto, nullptr, nullptr}, true, nullptr,
+                                report);
+}
+
+template <typename CellT>
+int goof2::execute(ForkedTape<CellT>& tape, std::string& code, bool optimize, int eof,
+                   ProfileInfo* profile, InstructionCache* cache, FlushPolicy flush,
+                   IoSource* input, IoSink* output) {
+    const IoConfig io{flush, input, output};
+    if (!tape.data) return -1;
+    // A fork that had to spill to the heap continues as an ordinary contiguous tape.
+    if (!tape.release) {
+        int ret = executeCached<CellT>(tape.spill, tape.cellPtr, code, optimize, eof, true, true,
+                                       MemoryModel::Contiguous, profile, cache, nullptr, io);
+        tape.data = tape.spill.data();
+        tape.size = tape.spill.size();
+        return ret;
+    }
+    return executeCached<CellT>(tape.spill, tape.cellPtr, code, optimize, eof, true, true,
+                                MemoryModel::OSBacked, profile, cache, &tape, io);
+}
+
+template int goof2::execute<uint8_t>(std::vector<uint8_t>&, size_t&, std::string&, bool, int,
+                                     bool, bool, goof2::MemoryModel, goof2::ProfileInfo*,
+                                     goof2::InstructionCache*, goof2::FlushPolicy,
+                                     goof2::IoSource*, goof2::IoSink*);
 template int goof2::execute<uint16_t>(std::vector<uint16_t>&, size_t&, std::string&, bool, int,
                                       bool, bool, goof2::MemoryModel, goof2::ProfileInfo*,
-                                      goof2::InstructionCache*);
+                                      goof2::InstructionCache*, goof2::FlushPolicy,
+                                      goof2::IoSource*, goof2::IoSink*);
 template int goof2::execute<uint32_t>(std::vector<uint32_t>&, size_t&, std::string&, bool, int,
                                       bool, bool, goof2::MemoryModel, goof2::ProfileInfo*,
-                                      goof2::InstructionCache*);
+                                      goof2::InstructionCache*, goof2::FlushPolicy,
+                                      goof2::IoSource*, goof2::IoSink*);
 template int goof2::execute<uint64_t>(std::vector<uint64_t>&, size_t&, std::string&, bool, int,
                                       bool, bool, goof2::MemoryModel, goof2::ProfileInfo*,
-                                      goof2::InstructionCache*);
+                                      goof2::InstructionCache*, goof2::FlushPolicy,
+                                      goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint8_t>(goof2::ForkedTape<uint8_t>&, std::string&, bool, int,
+                                     goof2::ProfileInfo*, goof2::InstructionCache*,
+                                     goof2::FlushPolicy, goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint16_t>(goof2::ForkedTape<uint16_t>&, std::string&, bool, int,
+                                      goof2::ProfileInfo*, goof2::InstructionCache*,
+                                      goof2::FlushPolicy, goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint32_t>(goof2::ForkedTape<uint32_t>&, std::string&, bool, int,
+                                      goof2::ProfileInfo*, goof2::InstructionCache*,
+                                      goof2::FlushPolicy, goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint64_t>(goof2::ForkedTape<uint64_t>&, std::string&, bool, int,
+                                      goof2::ProfileInfo*, goof2::InstructionCache*,
+                                      goof2::FlushPolicy, goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint8_t>(std::vector<uint8_t>&, size_t&, std::string&,
+                                     goof2::CompileSession&, bool, int, bool, bool,
+                                     goof2::MemoryModel, goof2::ProfileInfo*, goof2::FlushPolicy,
+                                     goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint16_t>(std::vector<uint16_t>&, size_t&, std::string&,
+                                      goof2::CompileSession&, bool, int, bool, bool,
+                                      goof2::MemoryModel, goof2::ProfileInfo*, goof2::FlushPolicy,
+                                      goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint32_t>(std::vector<uint32_t>&, size_t&, std::string&,
+                                      goof2::CompileSession&, bool, int, bool, bool,
+                                      goof2::MemoryModel, goof2::ProfileInfo*, goof2::FlushPolicy,
+                                      goof2::IoSource*, goof2::IoSink*);
+template int goof2::execute<uint64_t>(std::vector<uint64_t>&, size_t&, std::string&,
+                                      goof2::CompileSession&, bool, int, bool, bool,
+                                      goof2::MemoryModel, goof2::ProfileInfo*, goof2::FlushPolicy,
+                                      goof2::IoSource*, goof2::IoSink*);
+template int goof2::compile<uint8_t>(std::string&, goof2::InstructionCache&, bool, int, bool,
+                                     bool, goof2::OptReport*);
+template int goof2::compile<uint16_t>(std::string&, goof2::InstructionCache&, bool, int, bool,
+                                      bool, goof2::OptReport*);
+template int goof2::compile<uint32_t>(std::string&, goof2::InstructionCache&, bool, int, bool,
+                                      bool, goof2::OptReport*);
+template int goof2::compile<uint64_t>(std::string&, goof2::InstructionCache&, bool, int, bool,
+                                      bool, goof2::OptReport*);
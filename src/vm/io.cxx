@@ -0,0 +1,351 @@
+#include "vm.hxx"
+#include "vm/io.hxx"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace goof2 {
+namespace {
+// Captured during static initialisation, before anything can redirect the standard streams.
+std::streambuf* const stdoutBuf = std::cout.rdbuf();
+std::streambuf* const stdinBuf = std::cin.rdbuf();
+
+constexpr size_t kInputBlock = size_t(1) << 18;
+constexpr size_t kAsyncBlock = size_t(1) << 20;
+// Bytes read from fd 0 but not consumed by the previous program. Like fd 0 itself, this is shared
+// by the whole process.
+std::string stdinPending;
+
+bool isTerminal(int fd) {
+#if defined(_WIN32)
+    return _isatty(fd) != 0;
+#else
+    return isatty(fd) != 0;
+#endif
+}
+
+// Returns 0 at end of file and on errors other than EINTR.
+size_t readFd(int fd, char* dst, size_t size) {
+    for (;;) {
+#if defined(_WIN32)
+        const unsigned chunk = size > (1u << 30) ? (1u << 30) : static_cast<unsigned>(size);
+        const int n = _read(fd, dst, chunk);
+#else
+        const ssize_t n = ::read(fd, dst, size);
+#endif
+        if (n < 0 && errno == EINTR) continue;
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+}
+
+bool writeFd(int fd, const char* data, size_t size) {
+    while (size) {
+#if defined(_WIN32)
+        const unsigned chunk = size > (1u << 30) ? (1u << 30) : static_cast<unsigned>(size);
+        const int n = _write(fd, data, chunk);
+#else
+        const ssize_t n = ::write(fd, data, size);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+}  // namespace
+
+size_t FdSource::read(char* dst, size_t size) { return readFd(fd, dst, size); }
+
+bool FdSink::write(const char* data, size_t size) { return writeFd(fd, data, size); }
+
+// Two output blocks: the program fills one while the thread writes the other.
+struct OutputBuffer::AsyncWriter {
+    std::unique_ptr<char[]> blocks[2]{std::make_unique<char[]>(kAsyncBlock),
+                                      std::make_unique<char[]>(kAsyncBlock)};
+    int active = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+    const char* pending = nullptr;
+    size_t pendingLen = 0;
+    bool stop = false;
+    double stalled = 0.0;
+    std::thread thread;
+
+    explicit AsyncWriter(OutputBuffer& owner) {
+        thread = std::thread([this, &owner] {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                cv.wait(lock, [this] { return pending || stop; });
+                if (!pending) return;
+                lock.unlock();
+                owner.write(pending, pendingLen);
+                lock.lock();
+                pending = nullptr;
+                cv.notify_all();
+            }
+        });
+    }
+    ~AsyncWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+    // Blocks until the previous block is written, counting the wait as a stall.
+    void wait(std::unique_lock<std::mutex>& lock) {
+        if (!pending) return;
+        const auto start = std::chrono::steady_clock::now();
+        cv.wait(lock, [this] { return !pending; });
+        stalled += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    char* submit(const char* block, size_t size) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wait(lock);
+        pending = block;
+        pendingLen = size;
+        cv.notify_all();
+        active ^= 1;
+        return blocks[active].get();
+    }
+    void finish() {
+        std::unique_lock<std::mutex> lock(mutex);
+        wait(lock);
+    }
+};
+
+OutputBuffer::OutputBuffer(FlushPolicy policy, IoSink* sink, double* stallSeconds)
+    : policy(policy), sink(sink), stallSeconds(stallSeconds) {
+    data = buf.data();
+    cap = buf.size();
+    if (!sink) {
+        std::streambuf* current = std::cout.rdbuf();
+        if (current == stdoutBuf) {
+            // Bypass iostreams; push out anything already written through them first.
+            std::cout.flush();
+            std::fflush(stdout);
+        } else {
+            stream = current;
+        }
+    }
+    if (this->policy == FlushPolicy::Auto) {
+        // Only flush ahead of reads when someone could be waiting to answer a prompt.
+        const bool interactive = std::cin.rdbuf() == stdinBuf && isTerminal(0);
+        if (sink)
+            this->policy = FlushPolicy::Full;
+        else if (!stream && isTerminal(1))
+            this->policy = FlushPolicy::Line;
+        else
+            this->policy = interactive ? FlushPolicy::BeforeInput : FlushPolicy::Full;
+    }
+    if (this->policy == FlushPolicy::Async) {
+        async = std::make_unique<AsyncWriter>(*this);
+        data = async->blocks[0].get();
+        cap = kAsyncBlock;
+    }
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+    if (async && stallSeconds) *stallSeconds += async->stalled;
+}
+
+void OutputBuffer::flush() {
+    if (len) drain();
+    if (async) async->finish();
+    if (failed) return;
+    if (sink)
+        sink->flush();
+    else if (stream)
+        stream->pubsync();
+}
+
+void OutputBuffer::drain() {
+    if (async)
+        data = async->submit(data, len);
+    else
+        write(data, len);
+    len = 0;
+}
+
+void OutputBuffer::putSlow(char ch, size_t count) {
+    while (count) {
+        if (len == cap) drain();
+        const size_t n = count < cap - len ? count : cap - len;
+        std::memset(data + len, static_cast<unsigned char>(ch), n);
+        len += n;
+        count -= n;
+    }
+}
+
+void OutputBuffer::putBlock(const char* bytes, size_t size) {
+    const bool newline = policy == FlushPolicy::Line && std::memchr(bytes, '\n', size);
+    if (!async && size >= cap) {
+        if (len) drain();
+        write(bytes, size);
+    } else {
+        while (size) {
+            if (len == cap) drain();
+            const size_t n = size < cap - len ? size : cap - len;
+            std::memcpy(data + len, bytes, n);
+            len += n;
+            bytes += n;
+            size -= n;
+        }
+    }
+    if (policy == FlushPolicy::Unbuffered || newline) flush();
+}
+
+void OutputBuffer::write(const char* bytes, size_t size) {
+    if (failed) return;
+    if (sink) {
+        failed = !sink->write(bytes, size);
+    } else if (stream) {
+        failed = stream->sputn(bytes, static_cast<std::streamsize>(size)) !=
+                 static_cast<std::streamsize>(size);
+    } else {
+        failed = !writeFd(1, bytes, size);
+    }
+}
+
+InputBuffer::~InputBuffer() {
+    if (source) {
+        if (window) source->consume(static_cast<size_t>(pos - window));
+        return;
+    }
+    if (!ready || stream) return;
+#if !defined(_WIN32)
+    if (map) {
+        // Leave fd 0 positioned after the bytes the program consumed.
+        const char* base = static_cast<const char*>(map);
+        ::lseek(STDIN_FILENO, static_cast<off_t>(mapOffset + (pos - base)), SEEK_SET);
+        ::munmap(map, mapSize);
+        return;
+    }
+#endif
+    if (pos != end) stdinPending.assign(pos, end);
+}
+
+void InputBuffer::init() {
+    ready = true;
+    if (source) {
+        // Memory-backed sources are read in place.
+        const std::string_view view = source->peek();
+        if (!view.empty()) {
+            window = pos = view.data();
+            end = pos + view.size();
+        }
+        return;
+    }
+    std::streambuf* current = std::cin.rdbuf();
+    if (current != stdinBuf) {
+        stream = current;
+        return;
+    }
+    if (!stdinPending.empty()) {
+        storage.assign(stdinPending.begin(), stdinPending.end());
+        stdinPending.clear();
+        pos = storage.data();
+        end = pos + storage.size();
+        return;
+    }
+#if !defined(_WIN32)
+    struct stat st{};
+    const off_t offset = ::lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (offset >= 0 && ::fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > offset) {
+        const long page = ::sysconf(_SC_PAGESIZE);
+        const off_t aligned = page > 0 ? offset - offset % page : 0;
+        const size_t length = static_cast<size_t>(st.st_size - aligned);
+        void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, STDIN_FILENO, aligned);
+        if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            ::madvise(p, length, MADV_SEQUENTIAL);
+#endif
+            map = p;
+            mapSize = length;
+            mapOffset = aligned;
+            pos = static_cast<const char*>(p) + (offset - aligned);
+            end = static_cast<const char*>(p) + length;
+        }
+    }
+#endif
+}
+
+int InputBuffer::getSlow() {
+    if (!ready) {
+        init();
+        if (pos != end) return static_cast<unsigned char>(*pos++);
+    }
+    if (stream) return stream->sbumpc();  // char_traits<char>::eof() is -1
+    if (!refill(1)) return -1;
+    return static_cast<unsigned char>(*pos++);
+}
+
+bool InputBuffer::refillAvailable() {
+    if (!ready) {
+        init();
+        if (pos != end) return true;
+    }
+    if (!stream) return refill(kInputBlock);
+    // Reading further ahead would take bytes the program never asked for from the caller's stream.
+    const std::streamsize buffered = stream->in_avail();
+    return refill(buffered > 0 ? static_cast<size_t>(buffered) : 1);
+}
+
+bool InputBuffer::refill(size_t want) {
+    if (!ready) {
+        init();
+        if (pos != end) return true;
+    }
+    // A mapped file has no more bytes than were mapped.
+    if (eof || map) return false;
+    if (window) {
+        source->consume(static_cast<size_t>(end - window));
+        window = nullptr;
+        const std::string_view view = source->peek();
+        if (!view.empty()) {
+            window = pos = view.data();
+            end = pos + view.size();
+            return true;
+        }
+    }
+    if (storage.size() < kInputBlock) storage.resize(kInputBlock);
+    size_t n;
+    if (source) {
+        n = source->read(storage.data(), storage.size());
+    } else if (stream) {
+        // Take exactly what the program asked for so nothing is lost from the caller's stream.
+        const auto wanted = static_cast<std::streamsize>(std::min(want, kInputBlock));
+        const std::streamsize got = stream->sgetn(storage.data(), wanted);
+        n = got > 0 ? static_cast<size_t>(got) : 0;
+    } else {
+        n = readFd(0, storage.data(), storage.size());
+    }
+    if (n == 0) {
+        eof = true;
+        return false;
+    }
+    pos = storage.data();
+    end = pos + n;
+    return true;
+}
+}  // namespace goof2
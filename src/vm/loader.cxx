@@ -0,0 +1,199 @@
+/*
+    Goof2 - An optimizing brainfuck VM
+    Source file loading
+    Published under the GNU AGPL-3.0-or-later license
+*/
+// SPDX-License-Identifier: AGPL-3.0-or-later
+#include "vm/loader.hxx"
+
+#include <simde/x86/avx2.h>
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <vector>
+
+#include "threadPool.hxx"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace goof2 {
+namespace {
+constexpr size_t kLoadChunk = size_t(1) << 22;
+constexpr size_t kReadBlock = size_t(1) << 20;
+
+constexpr std::array<bool, 256> bfTable = [] {
+    std::array<bool, 256> table{};
+    for (unsigned char c : {'+', '-', '>', '<', '[', ']', '.', ','}) table[c] = true;
+    return table;
+}();
+
+// Bit i is set when byte i of the 32 at p is a command.
+inline uint32_t commandMask(const char* p) {
+    const simde__m256i v = simde_mm256_loadu_si256(reinterpret_cast<const simde__m256i*>(p));
+    simde__m256i hit = simde_mm256_setzero_si256();
+    for (char c : {'+', '-', '>', '<', '[', ']', '.', ','})
+        hit = simde_mm256_or_si256(hit, simde_mm256_cmpeq_epi8(v, simde_mm256_set1_epi8(c)));
+    return static_cast<uint32_t>(simde_mm256_movemask_epi8(hit));
+}
+
+size_t countCommands(const char* src, size_t size) {
+    size_t n = 0, i = 0;
+    for (; i + 32 <= size; i += 32) n += static_cast<size_t>(std::popcount(commandMask(src + i)));
+    for (; i < size; ++i) n += bfTable[static_cast<unsigned char>(src[i])];
+    return n;
+}
+
+// Cross-platform read-only mapping of a whole regular file.
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMap = nullptr;
+#else
+    int fd = -1;
+#endif
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (data) UnmapViewOfFile(data);
+        if (hMap) CloseHandle(hMap);
+        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+#else
+        if (data) munmap(const_cast<char*>(data), size);
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    // False when the file cannot be mapped; an empty file maps to no data.
+    bool open(const std::string& path) {
+#if defined(_WIN32)
+        hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER sz{};
+        if (!GetFileSizeEx(hFile, &sz)) return false;
+        if (sz.QuadPart == 0) return true;
+        hMap = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!hMap) return false;
+        void* view = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+        if (!view) return false;
+        data = static_cast<const char*>(view);
+        size = static_cast<size_t>(sz.QuadPart);
+        return true;
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+        if (st.st_size == 0) return true;
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) return false;
+#ifdef MADV_SEQUENTIAL
+        madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+#endif
+        data = static_cast<const char*>(view);
+        size = static_cast<size_t>(st.st_size);
+        return true;
+#endif
+    }
+};
+
+// Filters a mapped file straight into out: each chunk is counted, then copied to its final offset.
+void filterMapped(const char* src, size_t size, std::string& out) {
+    const size_t chunks = (size + kLoadChunk - 1) / kLoadChunk;
+    if (chunks <= 1) {
+        out.resize_and_overwrite(size, [&](char* dst, size_t) {
+            return filterSource(src, size, dst);
+        });
+        return;
+    }
+    static ThreadPool pool;
+    auto chunkSize = [&](size_t c) { return std::min(kLoadChunk, size - c * kLoadChunk); };
+    std::vector<std::future<size_t>> counts;
+    counts.reserve(chunks);
+    for (size_t c = 0; c < chunks; ++c)
+        counts.push_back(pool.submit(countCommands, src + c * kLoadChunk, chunkSize(c)));
+    std::vector<size_t> offsets(chunks + 1, 0);
+    for (size_t c = 0; c < chunks; ++c) offsets[c + 1] = offsets[c] + counts[c].get();
+    out.resize_and_overwrite(offsets[chunks], [&](char* dst, size_t total) {
+        std::vector<std::future<size_t>> copies;
+        copies.reserve(chunks);
+        for (size_t c = 0; c < chunks; ++c)
+            copies.push_back(
+                pool.submit(filterSource, src + c * kLoadChunk, chunkSize(c), dst + offsets[c]));
+        for (auto& f : copies) f.get();
+        return total;
+    });
+}
+}  // namespace
+
+size_t filterSource(const char* src, size_t size, char* dst) {
+    size_t n = 0, i = 0;
+    for (; i + 32 <= size; i += 32) {
+        uint32_t mask = commandMask(src + i);
+        if (mask == 0xFFFFFFFFu) {
+            std::memmove(dst + n, src + i, 32);
+            n += 32;
+            continue;
+        }
+        while (mask) {
+            dst[n++] = src[i + static_cast<size_t>(std::countr_zero(mask))];
+            mask &= mask - 1;
+        }
+    }
+    for (; i < size; ++i) {
+        if (bfTable[static_cast<unsigned char>(src[i])]) dst[n++] = src[i];
+    }
+    return n;
+}
+
+bool loadSource(const std::string& path, std::string& out, std::string& err) {
+    {
+        MappedFile mf;
+        if (mf.open(path)) {
+            if (mf.size == 0)
+                out.clear();
+            else
+                filterMapped(mf.data, mf.size, out);
+            return true;
+        }
+    }
+    // Pipes and other unmappable files: filter each block as it arrives.
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        err = "File could not be opened";
+        return false;
+    }
+    std::string compact;
+    std::vector<char> block(kReadBlock);
+    while (in) {
+        in.read(block.data(), static_cast<std::streamsize>(block.size()));
+        const size_t got = static_cast<size_t>(in.gcount());
+        if (got == 0) break;
+        const size_t old = compact.size();
+        compact.resize_and_overwrite(old + got, [&](char* dst, size_t) {
+            return old + filterSource(block.data(), got, dst + old);
+        });
+    }
+    if (!in.eof() && in.fail()) {
+        err = "Error while reading file";
+        return false;
+    }
+    out.swap(compact);
+    return true;
+}
+}  // namespace goof2
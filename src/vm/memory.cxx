@@ -1,13 +1,24 @@
-#include "vm/memory.hxx"
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
 
 #include "vm.hxx"
+#include "vm/memory.hxx"
 
 #if GOOF2_HAS_OS_VM
+#include <cstring>
+
 #if defined(_WIN32)
 #include <windows.h>
 #else
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+
+#include <atomic>
+#include <string>
 #endif
 
 namespace goof2 {
@@ -32,5 +43,125 @@ void defaultOsFree(void* ptr, size_t bytes) { munmap(ptr, bytes); }
 
 void* (*os_alloc)(size_t) = defaultOsAlloc;
 void (*os_free)(void*, size_t) = defaultOsFree;
+
+namespace {
+constexpr size_t kImagePage = 4096;
+
+bool pageIsZero(const unsigned char* p, size_t n) {
+    uint64_t acc = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        acc |= w;
+    }
+    for (; i < n; ++i) acc |= p[i];
+    return acc == 0;
+}
+
+// Copy only non-zero pages so untouched tape regions stay holes in the shared object.
+void copyNonZeroPages(unsigned char* dst, const unsigned char* src, size_t bytes) {
+    for (size_t off = 0; off < bytes; off += kImagePage) {
+        const size_t n = bytes - off < kImagePage ? bytes - off : kImagePage;
+        if (!pageIsZero(src + off, n)) std::memcpy(dst + off, src + off, n);
+    }
+}
+
+#if !defined(_WIN32)
+int createSharedFd() {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    int fd = memfd_create("goof2-tape", MFD_CLOEXEC);
+    if (fd >= 0) return fd;
+#endif
+    static std::atomic<unsigned> counter{0};
+    const std::string name = "/goof2-tape-" + std::to_string(getpid()) + "-" +
+                             std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+    int fd2 = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd2 >= 0) shm_unlink(name.c_str());
+    return fd2;
+}
+#endif
+}  // namespace
+
+TapeImage& TapeImage::operator=(TapeImage&& other) noexcept {
+    if (this != &other) {
+        close();
+        handle = other.handle;
+        size = other.size;
+        other.handle = invalidHandle;
+        other.size = 0;
+    }
+    return *this;
+}
+
+#if defined(_WIN32)
+TapeImage::TapeImage(const void* data, size_t bytes) {
+    if (!bytes) return;
+    const auto total = static_cast<unsigned long long>(bytes);
+    HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(total >> 32),
+                                        static_cast<DWORD>(total & 0xFFFFFFFFull), nullptr);
+    if (!section) return;
+    void* view = MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, bytes);
+    if (!view) {
+        CloseHandle(section);
+        return;
+    }
+    copyNonZeroPages(static_cast<unsigned char*>(view), static_cast<const unsigned char*>(data),
+                     bytes);
+    UnmapViewOfFile(view);
+    handle = reinterpret_cast<intptr_t>(section);
+    size = bytes;
+}
+
+void TapeImage::close() {
+    if (handle != invalidHandle) CloseHandle(reinterpret_cast<HANDLE>(handle));
+    handle = invalidHandle;
+    size = 0;
+}
+
+void* TapeImage::map() const {
+    if (handle == invalidHandle) return nullptr;
+    return MapViewOfFile(reinterpret_cast<HANDLE>(handle), FILE_MAP_COPY, 0, 0, size);
+}
+
+void TapeImage::unmap(void* ptr, size_t) { UnmapViewOfFile(ptr); }
+#else
+TapeImage::TapeImage(const void* data, size_t bytes) {
+    if (!bytes) return;
+    int fd = createSharedFd();
+    if (fd < 0) return;
+    const size_t pageBytes = (bytes + kImagePage - 1) / kImagePage * kImagePage;
+    if (ftruncate(fd, static_cast<off_t>(pageBytes)) != 0) {
+        ::close(fd);
+        return;
+    }
+    void* view = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        ::close(fd);
+        return;
+    }
+    copyNonZeroPages(static_cast<unsigned char*>(view), static_cast<const unsigned char*>(data),
+                     bytes);
+    munmap(view, bytes);
+    handle = fd;
+    size = bytes;
+}
+
+void TapeImage::close() {
+    if (handle != invalidHandle) ::close(static_cast<int>(handle));
+    handle = invalidHandle;
+    size = 0;
+}
+
+void* TapeImage::map() const {
+    if (handle == invalidHandle) return nullptr;
+    void* view =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, static_cast<int>(handle), 0);
+    return view == MAP_FAILED ? nullptr : view;
+}
+
+void TapeImage::unmap(void* ptr, size_t bytes) { munmap(ptr, bytes); }
+#endif
 }  // namespace goof2
 #endif
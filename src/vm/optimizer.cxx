@@ -1,11 +1,17 @@
 #include "vm/optimizer.hxx"
 
+#include <array>
+#include <cctype>
+#include <cstdlib>
+
 namespace goof2::vmRegex {
 using namespace std::regex_constants;
 const std::regex nonInstructionRe(R"([^+\-<>\.,\]\[])", optimize | nosubs);
-const std::regex balanceSeqRe(R"([+-]{2,}|[><]{2,})", optimize | nosubs);
+const std::regex streamCopyRe(R"(\[-\.(?:\[-\]-)?,\+\]|\[\.(?:\[-\])?,\])", optimize | nosubs);
+const std::regex divmodRe(R"(\[->\+>-\[>\+>>\]>\[\+\[-<\+>\]>\+>>\]<<<<<<\])",
+                          optimize | nosubs);
 const std::regex clearLoopRe(R"([+-]*\[[+-]+\](?:\[[+-]+\])*)", optimize | nosubs);
-const std::regex scanLoopClrRe(R"(\[-[<>]+\]|\[[<>]\[-\]\])", optimize | nosubs);
+const std::regex scanLoopClrRe(R"(\[\[-\][<>]+\])", optimize | nosubs);
 const std::regex scanLoopRe(R"(\[[<>]+\])", optimize | nosubs);
 const std::regex commaTrimRe(R"([+\-C]+,)", optimize | nosubs);
 const std::regex clearThenSetRe(R"(C([+-]+))", optimize);
@@ -15,3 +21,198 @@ const std::regex copyLoopInnerRe(R"((?:<+|>+)[+-]+)", optimize | nosubs);
 const std::regex clearSeqRe(R"(C{2,})", optimize | nosubs);
 const std::regex clearPassRe(R"((C([+-]+))|C{2,})", optimize);
 }  // namespace goof2::vmRegex
+
+namespace goof2 {
+namespace {
+bool isMove(char c) { return c == '>' || c == '<'; }
+bool isAdd(char c) { return c == '+' || c == '-'; }
+bool isName(char c) { return c >= 'a' && c <= 'z'; }
+
+// Reads the loop shape of an idiom into its pattern and slots. A run command followed by a letter
+// is a placeholder for a whole run of either direction; a run without one matches only a run of
+// that length. Runs of the same kind cannot touch, as the code they match has them merged.
+bool parsePattern(std::string_view text, Idiom& idiom, std::string& err) {
+    if (!text.starts_with('[')) {
+        err = "the shape must be one loop";
+        return false;
+    }
+    std::string re;
+    char lastKind = 0;
+    int depth = 0;
+    for (size_t i = 0; i < text.size();) {
+        const char c = text[i];
+        if (isMove(c) || isAdd(c)) {
+            const bool move = isMove(c);
+            const char kind = move ? '>' : '+';
+            if (kind == lastKind) {
+                err = "runs of the same command must be written as one";
+                return false;
+            }
+            lastKind = kind;
+            if (i + 1 < text.size() && isName(text[i + 1])) {
+                idiom.slots.push_back(Idiom::Slot{text[i + 1], c == '<' || c == '-'});
+                re += move ? "(>+|<+)" : "(\\++|-+)";
+                i += 2;
+                continue;
+            }
+            ptrdiff_t net = 0;
+            for (; i < text.size() && (move ? isMove(text[i]) : isAdd(text[i])); ++i) {
+                if (i + 1 < text.size() && isName(text[i + 1])) break;
+                net += text[i] == '>' || text[i] == '+' ? 1 : -1;
+            }
+            if (net == 0) {
+                err = "a run cancels out";
+                return false;
+            }
+            re += move ? (net > 0 ? ">" : "<") : (net > 0 ? "\\+" : "-");
+            re += "{" + std::to_string(std::abs(net)) + "}";
+            re += move ? "(?![<>])" : "(?![+-])";
+            continue;
+        }
+        lastKind = 0;
+        if (c == '[') {
+            ++depth;
+        } else if (c == ']') {
+            if (--depth < 0) {
+                err = "unmatched ']' in the loop";
+                return false;
+            }
+        } else if (c != '.' && c != ',') {
+            err = std::string("unexpected '") + c + "' in the loop";
+            return false;
+        }
+        if (depth == 0 && i + 1 != text.size()) {
+            err = "the shape must be one loop";
+            return false;
+        }
+        if (c != ',') re += '\\';
+        re += c;
+        ++i;
+    }
+    if (depth != 0) {
+        err = "the shape must be one loop";
+        return false;
+    }
+    idiom.pattern = std::regex(re, std::regex_constants::optimize);
+    return true;
+}
+
+// Checks a template: commands, with placeholders the pattern binds after run commands, and
+// balanced brackets.
+bool checkTemplate(std::string_view text, const Idiom& idiom, std::string& err) {
+    int depth = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        if ((isMove(c) || isAdd(c)) && i + 1 < text.size() && isName(text[i + 1])) {
+            const char name = text[++i];
+            const auto named = [name](const Idiom::Slot& slot) { return slot.name == name; };
+            if (std::ranges::none_of(idiom.slots, named)) {
+                err = std::string("'") + name + "' is not in the loop";
+                return false;
+            }
+        } else if (c == '[') {
+            ++depth;
+        } else if (c == ']') {
+            if (--depth < 0) break;
+        } else if (!isMove(c) && !isAdd(c) && c != '.' && c != ',') {
+            err = std::string("unexpected '") + c + "' in the replacement";
+            return false;
+        }
+    }
+    if (depth != 0) {
+        err = "unbalanced brackets in the replacement";
+        return false;
+    }
+    return true;
+}
+}  // namespace
+
+bool parseIdioms(std::string_view text, std::vector<Idiom>& out, std::string& err) {
+    std::vector<Idiom> idioms;
+    size_t lineNo = 0;
+    while (!text.empty()) {
+        ++lineNo;
+        const size_t eol = text.find('\n');
+        std::string_view line = text.substr(0, eol);
+        text = eol == std::string_view::npos ? std::string_view{} : text.substr(eol + 1);
+        std::vector<std::string_view> fields;
+        for (size_t i = 0; i < line.size();) {
+            if (std::isspace(static_cast<unsigned char>(line[i]))) {
+                ++i;
+                continue;
+            }
+            if (fields.empty() && line[i] == '#') break;
+            size_t j = i;
+            while (j < line.size() && !std::isspace(static_cast<unsigned char>(line[j]))) ++j;
+            fields.push_back(line.substr(i, j - i));
+            i = j;
+        }
+        if (fields.empty()) continue;
+        auto fail = [&](const std::string& why) {
+            err = "line " + std::to_string(lineNo) + ": " + why;
+            return false;
+        };
+        if (fields.size() != 3) return fail("expected a name, a loop and its replacement");
+        Idiom idiom;
+        idiom.name = fields[0];
+        if (!std::ranges::all_of(idiom.name, [](char c) {
+                return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+            }))
+            return fail("names may only hold letters, digits, '_' and '-'");
+        std::string why;
+        if (!parsePattern(fields[1], idiom, why)) return fail(why);
+        if (fields[2] == "clear") {
+            idiom.builtin = Idiom::Builtin::Clear;
+        } else if (fields[2] == "divmod") {
+            idiom.builtin = Idiom::Builtin::Divmod;
+        } else {
+            if (!checkTemplate(fields[2], idiom, why)) return fail(why);
+            idiom.replacement = fields[2];
+        }
+        idioms.push_back(std::move(idiom));
+    }
+    out = std::move(idioms);
+    return true;
+}
+
+bool expandIdiom(const Idiom& idiom, const SvMatch& what, std::string& out) {
+    std::array<ptrdiff_t, 26> values{};
+    std::array<bool, 26> bound{};
+    for (size_t k = 0; k < idiom.slots.size(); ++k) {
+        const Idiom::Slot& slot = idiom.slots[k];
+        const char first = *what[k + 1].first;
+        const ptrdiff_t length = what[k + 1].length();
+        ptrdiff_t value = first == '>' || first == '+' ? length : -length;
+        if (slot.negated) value = -value;
+        const size_t at = static_cast<size_t>(slot.name - 'a');
+        if (bound[at] && values[at] != value) return false;
+        bound[at] = true;
+        values[at] = value;
+    }
+    switch (idiom.builtin) {
+        case Idiom::Builtin::Clear:
+            out = "C";
+            return true;
+        case Idiom::Builtin::Divmod:
+            // DIVMOD leaves the loop to run when its scratch cells are not clear.
+            out = "D" + what.str();
+            return true;
+        case Idiom::Builtin::None:
+            break;
+    }
+    out.clear();
+    const std::string_view text = idiom.replacement;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        if (!(isMove(c) || isAdd(c)) || i + 1 == text.size() || !isName(text[i + 1])) {
+            out += c;
+            continue;
+        }
+        ptrdiff_t value = values[static_cast<size_t>(text[++i] - 'a')];
+        if (c == '<' || c == '-') value = -value;
+        const char up = isMove(c) ? '>' : '+', down = isMove(c) ? '<' : '-';
+        out.append(static_cast<size_t>(std::abs(value)), value > 0 ? up : down);
+    }
+    return true;
+}
+}  // namespace goof2
@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vm.hxx"
+
+// Builds a program dense in clear, copy and scan loops, the idioms the optimizer rewrites. It
+// runs on a zero tape, so every loop is skipped and the timing is dominated by compilation.
+static std::string makeProgram(size_t size) {
+    static const char* pieces[] = {"[-]", "[->+<]", "[->>+<<]", "[->+>++<<]", "[>]",  "[<]",
+                                   "[[-]>]", "[>+<-]", "[<[-]>-]", ">+<",     "[.,]", ",[-]"};
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, std::size(pieces) - 1);
+    std::string code;
+    code.reserve(size + 16);
+    while (code.size() < size) code += pieces[pick(rng)];
+    return code;
+}
+
+static double bench(size_t size, int iterations) {
+    const std::string program = makeProgram(size);
+    double best = 0.0;
+    for (int i = 0; i < iterations; ++i) {
+        goof2::clearLoopCache();
+        std::vector<uint8_t> cells(1 << 16, 0);
+        size_t ptr = 0;
+        std::string code = program;
+        goof2::SpanSource in("");
+        std::string out;
+        goof2::StringSink sink(out);
+        const auto start = std::chrono::steady_clock::now();
+        goof2::execute<uint8_t>(cells, ptr, code, true, 0, true, false, goof2::MemoryModel::Auto,
+                                nullptr, nullptr, goof2::FlushPolicy::Auto, &in, &sink);
+        const double ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                .count();
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+// Time to rerun the program in a compile session after one character in its middle changed.
+static double benchEdit(size_t size) {
+    const std::string program = makeProgram(size);
+    goof2::CompileSession session;
+    std::string out;
+    goof2::StringSink sink(out);
+    double last = 0.0;
+    for (const std::string& source : {program, program.substr(0, size / 2) + ">" +
+                                                   program.substr(size / 2)}) {
+        std::vector<uint8_t> cells(1 << 16, 0);
+        size_t ptr = 0;
+        std::string code = source;
+        goof2::SpanSource in("");
+        const auto start = std::chrono::steady_clock::now();
+        goof2::execute<uint8_t>(cells, ptr, code, session, true, 0, true, false,
+                                goof2::MemoryModel::Auto, nullptr, goof2::FlushPolicy::Auto, &in,
+                                &sink);
+        last = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                   .count();
+    }
+    return last;
+}
+
+int main() {
+    for (size_t size : {size_t(64) << 10, size_t(256) << 10, size_t(1) << 20, size_t(4) << 20})
+        std::cout << (size >> 10) << " KiB " << bench(size, 3) << " ms, after an edit "
+                  << benchEdit(size) << " ms\n";
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Runs `goof2 --inputs <dir> --out-dir <dir>` over a handful of files and checks every output.
+
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static int runGoof2(std::vector<std::string> args) {
+    args.insert(args.begin(), GOOF2_EXE_PATH);
+    std::vector<char*> argv;
+    for (auto& s : args) argv.push_back(s.data());
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static std::string slurp(const fs::path& p) {
+    std::ifstream in(p, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+int main() {
+    const fs::path root = fs::temp_directory_path() / ("goof2-batch-" + std::to_string(getpid()));
+    const fs::path in = root / "in";
+    const fs::path out = root / "out";
+    fs::create_directories(in);
+    std::vector<std::string> inputs;
+    // The last file spans many of the blocks input is read in.
+    for (int i = 0; i < 12; ++i) {
+        const size_t size = i == 11 ? size_t(1) << 20 : static_cast<size_t>(i * 37);
+        inputs.push_back(std::string(size, static_cast<char>('a' + i)) + "xyz");
+        std::ofstream(in / ("file" + std::to_string(i) + ".txt"), std::ios::binary)
+            << inputs.back();
+    }
+
+    // Shift every input byte up by one.
+    int rc = runGoof2({"-e", ",[+.,]", "-eof", "1", "--inputs", in.string(), "--out-dir",
+                       out.string()});
+    assert(rc == 0);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        std::string expected = inputs[i];
+        for (char& c : expected) ++c;
+        const std::string written = slurp(out / ("file" + std::to_string(i) + ".txt"));
+        assert(written == expected);
+        (void)written;
+    }
+
+    // Compile errors are reported once, before any input runs.
+    rc = runGoof2({"-e", "[", "--inputs", in.string(), "--out-dir", (root / "bad").string()});
+    assert(rc != 0);
+    rc = runGoof2({"-e", ",.", "--inputs", in.string(), "--out-dir", in.string()});
+    assert(rc != 0);
+    (void)rc;
+
+    fs::remove_all(root);
+    return 0;
+}
@@ -20,8 +20,10 @@
 #include <unistd.h>
 #endif
 
-static std::string run_inline(const std::string& code, const std::string& extra = "") {
+static std::string run_inline(const std::string& code, const std::string& extra = "",
+                              const std::string& stdinPath = "") {
 #ifdef _WIN32
+    (void)stdinPath;
     // Windows fallback using _popen. The "code" parameter is restricted to the
     // Brainfuck instruction set to avoid command injection when constructing
     // the command line.
@@ -58,6 +60,11 @@ static std::string run_inline(const std::string& code, const std::string& extra
         close(pipefd[0]);
         dup2(pipefd[1], STDOUT_FILENO);
         dup2(pipefd[1], STDERR_FILENO);
+        if (!stdinPath.empty()) {
+            FILE* in = std::fopen(stdinPath.c_str(), "rb");
+            if (!in) _exit(126);
+            dup2(fileno(in), STDIN_FILENO);
+        }
         execv(argv[0], argv.data());
         _exit(127);
     }
@@ -84,5 +91,29 @@ int main() {
     assert(hashOutput(out) == 0x13099d40d095b684ULL);
     out = run_inline(helloA, "-i nofile.bf");
     assert(hashOutput(out) == 0x13099d40d095b684ULL);
+    for (const char* mode : {"unbuffered", "line", "full", "before-input", "async"}) {
+        out = run_inline(helloA, std::string("--flush ") + mode);
+        assert(hashOutput(out) == 0x13099d40d095b684ULL);
+    }
+    // Banner text printed through iostreams stays ahead of the program's raw output.
+    out = run_inline(helloA, "-cw 16 --flush full");
+    assert(out == "Active cell width: 16 bits\nA");
+#ifndef _WIN32
+    // Input from a regular file is mapped rather than read; the result must be the same.
+    const std::string inPath = "/tmp/goof2-cli-input-" + std::to_string(getpid()) + ".txt";
+    std::string text;
+    for (int i = 0; i < 20000; ++i) text += "line " + std::to_string(i) + "\n";
+    {
+        FILE* f = std::fopen(inPath.c_str(), "wb");
+        assert(f);
+        std::fwrite(text.data(), 1, text.size(), f);
+        std::fclose(f);
+    }
+    out = run_inline(",[.,]", "-eof 1", inPath);
+    assert(out == text);
+    out = run_inline(",>,>,<<.>.>.", "-eof 1", inPath);
+    assert(out == "lin");
+    std::remove(inPath.c_str());
+#endif
     return 0;
 }
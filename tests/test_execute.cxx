@@ -1,10 +1,15 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <limits>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "helpers.hxx"
@@ -46,6 +51,52 @@ static void test_io() {
     assert(cells[0] == static_cast<CellT>('A'));
 }
 
+template <typename CellT>
+static void test_block_read() {
+    std::vector<CellT> cells(4, 7);
+    size_t ptr = 0;
+    // Consecutive reads are folded into one block read; EOF applies to each missing byte.
+    run<CellT>(",>,>,>,", cells, ptr, "AB", 1);
+    assert(cells[0] == static_cast<CellT>('A'));
+    assert(cells[1] == static_cast<CellT>('B'));
+    assert(cells[2] == 0 && cells[3] == 0);
+    cells.assign(4, 7);
+    ptr = 0;
+    run<CellT>(",>,>,", cells, ptr, "A", 0);
+    assert(cells[0] == static_cast<CellT>('A') && cells[1] == 7 && cells[2] == 7);
+    // A long stream through the single-byte path.
+    std::string text(100000, 'x');
+    std::string out = run<CellT>(",[.,]", cells, ptr, text, 1);
+    assert(out == text);
+}
+
+template <typename CellT>
+static void test_stream_copy() {
+    std::vector<CellT> cells(2, 0);
+    size_t ptr = 0;
+    const std::string data("ab\0cd\xff" "ef", 8);
+    // Output already buffered stays ahead of the copied bytes; the loop stops on a zero byte.
+    std::string out = run<CellT>("+++++[>+++++++++++++<-]>.<,[.,]", cells, ptr, data, 1);
+    assert(out == "Aab" && cells[0] == 0);
+    // The biased forms stop on a 255 byte only where that wraps the cell to zero.
+    cells.assign(2, 0);
+    ptr = 0;
+    out = run<CellT>(",+[-.[-]-,+]", cells, ptr, data, 0);
+    assert(out == (sizeof(CellT) == 1 ? std::string("ab\0cd", 5) : data));
+    // EOF left unchanged ends the loops that reset the cell before reading.
+    for (const char* code : {",+[-.[-]-,+]", ",[.[-],]"}) {
+        cells.assign(2, 0);
+        ptr = 0;
+        out = run<CellT>(code, cells, ptr, "xyz", 0);
+        assert(out == "xyz" && cells[0] == 0);
+    }
+    // Input after the stop byte is left for the next read.
+    cells.assign(2, 0);
+    ptr = 0;
+    out = run<CellT>(",[.,]>,.", cells, ptr, std::string("hi\0!", 4), 1);
+    assert(out == "hi!");
+}
+
 template <typename CellT>
 static void test_wrapping() {
     std::vector<CellT> cells(1, 0);
@@ -112,6 +163,48 @@ static void test_mul_cpy() {
     assert(cells[0] == 0);
 }
 
+// Loops that step the cell they test by an odd amount and only add to or set other cells run in
+// closed form, so a loop counting up from 3 takes no longer on 64-bit cells than on 8-bit ones.
+template <typename CellT>
+static void test_closed_form_loops() {
+    std::vector<CellT> cells(4, 0);
+    size_t ptr = 0;
+    goof2::InstructionCache cache;
+    run<CellT>(",[>++<+>>-<<]", cells, ptr, "\3", 0, true, nullptr, nullptr, &cache);
+    const CellT trips = static_cast<CellT>(-3);
+    assert(cells[0] == 0 && cells[1] == static_cast<CellT>(2 * trips) && cells[2] == 3);
+    for (const instruction& inst : *cache.begin()->second.instructions)
+        assert(inst.op != insType::JMP_ZER && inst.op != insType::JMP_NOT_ZER);
+
+    cells.assign(4, 0);
+    run<CellT>(",[>+<->>[-]++>+++<<<]", cells, ptr, "\5");
+    assert(cells[0] == 0 && cells[1] == 5 && cells[2] == 2 && cells[3] == 15);
+    for (const char input : {'\0', '\2'}) {
+        cells.assign(4, 0);
+        run<CellT>(",>+++<[>[-]<-]", cells, ptr, std::string(1, input));
+        assert(cells[0] == 0 && cells[1] == (input ? 0 : 3));
+    }
+
+    // An odd step wraps the cell around to zero after a trip count found with its inverse; up
+    // to 16 bits any factor fits one instruction.
+    if constexpr (sizeof(CellT) <= 2) {
+        for (const auto& [program, step, add] :
+             {std::tuple{",[--->+<]", 3, 1}, std::tuple{",[+++++>--<]", -5, -2}}) {
+            CellT counter = 7, sum = 0;
+            while (counter) {
+                counter = static_cast<CellT>(counter - step);
+                sum = static_cast<CellT>(sum + add);
+            }
+            cells.assign(4, 0);
+            goof2::InstructionCache cache;
+            run<CellT>(program, cells, ptr, "\7", 0, true, nullptr, nullptr, &cache);
+            assert(cells[0] == 0 && cells[1] == sum);
+            for (const instruction& inst : *cache.begin()->second.instructions)
+                assert(inst.op != insType::JMP_ZER);
+        }
+    }
+}
+
 template <typename CellT>
 static void test_scan_stride() {
     {
@@ -187,6 +280,37 @@ static void test_scan_clear() {
         assert(cells[1] == 0);
         assert(cells[2] == 1);
     }
+    {
+        // Clearing scans zero every cell they pass, whatever its value.
+        std::vector<CellT> cells{0, 3, 2, 5, 0};
+        size_t ptr = 3;
+        run<CellT>("[[-]<]>>>>[[-]>]", cells, ptr);
+        assert(ptr == 4);
+        assert(std::ranges::all_of(cells, [](CellT c) { return c == 0; }));
+    }
+    {
+        // A clear nested in a clearing scan belongs to the scan.
+        std::vector<CellT> cells{0, 4, 4, 0, 0, 0};
+        size_t ptr = 1;
+        run<CellT>("[[-]>]+", cells, ptr);
+        assert(ptr == 3 && cells[1] == 0 && cells[2] == 0 && cells[3] == 1);
+    }
+}
+
+template <typename CellT>
+static void test_rewrite_order() {
+    // Distinct copy loops keep their own targets and factors.
+    std::vector<CellT> cells(6, 0);
+    size_t ptr = 0;
+    run<CellT>("++[->+<]>>+++[->>++<<]>>>+[-<<+>>]", cells, ptr);
+    assert(cells[1] == 2 && cells[4] == 6 && cells[3] == 1);
+    // Loops that differ only in their folded copy factors are cached separately.
+    for (int factor : {1, 2}) {
+        cells.assign(4, 0);
+        ptr = 0;
+        run<CellT>("++[>+++[->" + std::string(factor, '+') + "<]<-]", cells, ptr);
+        assert(cells[2] == static_cast<CellT>(6 * factor));
+    }
 }
 
 template <typename CellT>
@@ -216,6 +340,78 @@ static void test_clr_then_set() {
     assert(profile.instructions == 2);
 }
 
+// The divmod loop of the esolang wiki runs as one DIVMOD when its scratch cells are clear and
+// it does not divide by one, and as the loop otherwise; the tape ends up the same either way.
+template <typename CellT>
+static void test_divmod() {
+    const std::string divmod = ">>>[->+>-[>+>>]>[+[-<+>]>+>>]<<<<<<]";
+    const std::vector<std::vector<CellT>> tapes = {
+        {0, 0, 0, 7, 0, 3},    {0, 0, 0, 250, 0, 7}, {0, 0, 0, 5, 0, 0},
+        {0, 0, 0, 0, 0, 4},    {0, 0, 0, 9, 2, 9, 0, 5}, {0, 0, 0, 5, 0, 1},
+        {0, 0, 0, 5, 0, 4, 1}, {0, 0, 0, 5, 0, 4, 0, 0, 0, 1}};
+    for (std::vector<CellT> tape : tapes) {
+        tape.resize(12);
+        const bool fast = tape[3] && tape[5] != 1 && !tape[6] && !tape[8] && !tape[9];
+        std::vector<std::vector<CellT>> results;
+        for (goof2::OptLevel level : {goof2::OptLevel::O1, goof2::OptLevel::O2}) {
+            goof2::setOptLevel(level);
+            std::vector<CellT> cells = tape;
+            size_t ptr = 0;
+            goof2::ProfileInfo profile;
+            run<CellT>(divmod, cells, ptr, "", 0, false, nullptr, &profile);
+            results.push_back(cells);
+            if (level == goof2::OptLevel::O2 && fast) assert(profile.instructions < 8);
+        }
+        assert(results[0] == results[1]);
+    }
+    std::vector<CellT> cells = tapes[1];
+    cells.resize(12);
+    size_t ptr = 0;
+    run<CellT>(divmod, cells, ptr);
+    assert(cells[3] == 0 && cells[4] == 250 && cells[5] == 7 - 250 % 7 && cells[6] == 250 % 7);
+    assert(cells[7] == 250 / 7 && ptr == 3);
+    goof2::setOptLevel(goof2::OptLevel::O3);
+}
+
+// A loop whose passes after the first add the same products each time runs its body once and
+// then adds the rest at once; one that adds its own counter stays a loop. Both match -O1.
+template <typename CellT>
+static void test_nested_loops() {
+    const std::string multiply = "[->[->+>+<<]>>[-<<+>>]<<<]";
+    std::vector<std::pair<std::string, std::vector<CellT>>> cases = {
+        {multiply, {12, 11, 0, 0}},
+        {multiply, {200, 200, 0, 0}},
+        {multiply, {5, 3, 7, 9}},
+        {multiply, {0, 4, 0, 0}},
+        {"[[->+>+<<]>[-<+>]<-]", {9, 0, 0, 0}},
+    };
+    // Counting down from 7 by 3 wraps the cell around first, too many passes for -O1 above 16
+    // bits.
+    if constexpr (sizeof(CellT) <= 2)
+        cases.push_back({"[>[->++>+<<]>>[-<<+>>]<<<---]", {7, 5, 1, 0}});
+    for (const auto& [program, tape] : cases) {
+        std::vector<std::vector<CellT>> results;
+        for (goof2::OptLevel level : {goof2::OptLevel::O1, goof2::OptLevel::O2}) {
+            goof2::setOptLevel(level);
+            std::vector<CellT> cells = tape;
+            cells.resize(8);
+            size_t ptr = 0;
+            goof2::ProfileInfo profile;
+            run<CellT>(program, cells, ptr, "", 0, false, nullptr, &profile);
+            results.push_back(cells);
+            if (level == goof2::OptLevel::O2 && program == multiply)
+                assert(profile.instructions < 16);
+        }
+        assert(results[0] == results[1]);
+    }
+    std::vector<CellT> cells{200, 200, 0, 0};
+    size_t ptr = 0;
+    run<CellT>(multiply, cells, ptr);
+    assert(cells[0] == 0 && cells[1] == 200 && cells[3] == 0);
+    assert(cells[2] == static_cast<CellT>(200 * 200));
+    goof2::setOptLevel(goof2::OptLevel::O3);
+}
+
 template <typename CellT>
 static void test_unmatched_brackets() {
     {
@@ -232,6 +428,29 @@ static void test_unmatched_brackets() {
         run<CellT>("[", cells, ptr, "", 0, true, &ret);
         assert(ret == 2);
     }
+    {
+        // Brackets found by the 32-byte scan and by the tail loop.
+        std::vector<CellT> cells(1, 0);
+        size_t ptr = 0;
+        int ret = 0;
+        run<CellT>("+[" + std::string(40, '.') + "]-]", cells, ptr, "", 0, true, &ret);
+        assert(ret == 1);
+        run<CellT>("[[" + std::string(40, '+') + "]", cells, ptr, "", 0, true, &ret);
+        assert(ret == 2);
+    }
+}
+
+template <typename CellT>
+static void test_long_runs() {
+    std::vector<CellT> cells(1, 0);
+    size_t ptr = 0;
+    const std::string code = std::string(200, '+') + std::string(37, '>') + "+++[>" +
+                             std::string(40, '+') + "<-]" + std::string(70, '-');
+    run<CellT>(code, cells, ptr);
+    assert(ptr == 37);
+    assert(cells[0] == static_cast<CellT>(200));
+    assert(cells[37] == static_cast<CellT>(-70));
+    assert(cells[38] == static_cast<CellT>(120));
 }
 
 template <typename CellT>
@@ -264,10 +483,544 @@ static void test_loop_cache_reuse() {
     assert(goof2::getLoopCache().size() == 1);
 }
 
+static void test_instruction_limit() {
+    // A run stops with -1 once it has run as many instructions as it may, also in a loop that
+    // never ends, and one that ends before that is not affected.
+    for (const std::string source : {"+[]", "+[-->+<]", "+++[->++<]"}) {
+        for (bool optimize : {false, true}) {
+            std::vector<uint8_t> cells(4, 0);
+            size_t ptr = 0;
+            std::string code = source;
+            goof2::ProfileInfo profile;
+            profile.instructionLimit = 1000;
+            const int ret = goof2::execute<uint8_t>(cells, ptr, code, optimize, 0, false, false,
+                                                    goof2::MemoryModel::Auto, &profile);
+            if (source == "+++[->++<]")
+                assert(ret == 0 && cells[1] == 6);
+            else
+                assert(ret == -1 && profile.instructions == 1000);
+            (void)ret;
+        }
+    }
+}
+
+// Counts how often the VM flushes into a redirected std::cout.
+class SyncCountingBuf : public std::stringbuf {
+   public:
+    int syncs = 0;
+
+   protected:
+    int sync() override {
+        ++syncs;
+        return std::stringbuf::sync();
+    }
+};
+
+static int flushCount(std::string code, goof2::FlushPolicy flush, const std::string& input,
+                      std::string& output) {
+    std::vector<uint8_t> cells(4, 0);
+    size_t ptr = 0;
+    std::stringbuf in(input);
+    SyncCountingBuf out;
+    auto* cinbuf = std::cin.rdbuf(&in);
+    auto* coutbuf = std::cout.rdbuf(&out);
+    // std::cin flushes its tied std::cout on every read; only count the VM's own flushes.
+    auto* tie = std::cin.tie(nullptr);
+    std::cin.clear();
+    goof2::execute<uint8_t>(cells, ptr, code, true, 0, true, false, goof2::MemoryModel::Auto,
+                            nullptr, nullptr, flush);
+    std::cin.tie(tie);
+    std::cin.rdbuf(cinbuf);
+    std::cout.rdbuf(coutbuf);
+    output = out.str();
+    return out.syncs;
+}
+
+static void test_flush_policy() {
+    const std::string lines = "++++++++[>++++++++<-]>+.<++++++++++.>.";  // "A\nA"
+    const std::string prompt = "++++++++[>++++++++<-]>+.,.";               // "A", then echo
+    std::string out;
+    // Output worked out at compile time is written in one block; count the flushes of a run.
+    goof2::setEvalBudget(0);
+    // Unbuffered writes each output instruction at once; "\nA" comes from two cells in a row and
+    // goes out as one block.
+    assert(flushCount(lines, goof2::FlushPolicy::Unbuffered, "", out) == 3);
+    assert(out == "A\nA");
+    assert(flushCount(lines, goof2::FlushPolicy::Line, "", out) == 2);
+    assert(out == "A\nA");
+    assert(flushCount(lines, goof2::FlushPolicy::Full, "", out) == 1);
+    assert(out == "A\nA");
+    assert(flushCount(prompt, goof2::FlushPolicy::BeforeInput, "B", out) == 2);
+    assert(out == "AB");
+    assert(flushCount(prompt, goof2::FlushPolicy::Full, "B", out) == 1);
+    assert(out == "AB");
+    // Runs longer than the buffer are split across several writes.
+    assert(flushCount("+[.+]", goof2::FlushPolicy::Full, "", out) == 1);
+    assert(out.size() == 255);
+    std::string big(70000, '.');
+    flushCount(std::string(65, '+') + big, goof2::FlushPolicy::Full, "", out);
+    assert(out == std::string(70000, 'A'));
+    // The async writer keeps output in order across buffer handoffs and never flushes early.
+    assert(flushCount(prompt, goof2::FlushPolicy::Async, "B", out) == 1);
+    assert(out == "AB");
+    std::vector<uint8_t> cells(1, 0);
+    size_t ptr = 0;
+    std::string code = "+[" + std::string(10000, '.') + "+]";
+    goof2::StringSink sink(out);
+    goof2::ProfileInfo profile;
+    out.clear();
+    goof2::execute<uint8_t>(cells, ptr, code, true, 0, true, false, goof2::MemoryModel::Auto,
+                            &profile, nullptr, goof2::FlushPolicy::Async, nullptr, &sink);
+    assert(out.size() == 2550000);
+    for (size_t i = 0; i < out.size(); i += 9999)
+        assert(static_cast<unsigned char>(out[i]) == 1 + i / 10000);
+    assert(profile.writerStallSeconds >= 0.0);
+    goof2::setEvalBudget(uint64_t(1) << 20);
+}
+
+static void test_io_interfaces() {
+    const std::string echo = ",[.,]";
+    std::vector<uint8_t> cells(4, 0);
+    size_t ptr = 0;
+    std::string code = echo;
+    goof2::SpanSource in("hello");
+    std::string result;
+    goof2::StringSink out(result);
+    goof2::execute<uint8_t>(cells, ptr, code, true, 1, true, false, goof2::MemoryModel::Auto,
+                            nullptr, nullptr, goof2::FlushPolicy::Auto, &in, &out);
+    assert(result == "hello");
+    assert(in.remaining().empty());
+
+    // A source without a peek window is pulled in blocks; a sink may refuse further output.
+    std::string pulled = "0123456789";
+    goof2::CallbackSource chunks([&pulled](char* dst, size_t size) {
+        const size_t n = std::min<size_t>({size, pulled.size(), 3});
+        pulled.copy(dst, n);
+        pulled.erase(0, n);
+        return n;
+    });
+    std::array<char, 4> small{};
+    goof2::SpanSink bounded(small);
+    code = echo;
+    ptr = 0;
+    goof2::execute<uint8_t>(cells, ptr, code, true, 1, true, false, goof2::MemoryModel::Auto,
+                            nullptr, nullptr, goof2::FlushPolicy::Unbuffered, &chunks, &bounded);
+    assert(bounded.size() == 4 && bounded.overflowed());
+    assert(std::string(small.data(), 4) == "0123");
+    assert(pulled.empty());
+
+    // Reads stop exactly where the program stopped reading.
+    goof2::SpanSource partial("ab");
+    code = ",.";
+    ptr = 0;
+    result.clear();
+    goof2::execute<uint8_t>(cells, ptr, code, true, 0, true, false, goof2::MemoryModel::Auto,
+                            nullptr, nullptr, goof2::FlushPolicy::Auto, &partial, &out);
+    assert(result == "a" && partial.remaining() == "b");
+}
+
+// Sources past the slicing threshold compile in parallel slices and must behave like the
+// unoptimized program.
+static void test_sliced_compile() {
+    // Small slices keep the source, and so the test, short while still cutting it in many.
+    goof2::setSliceSize(1024);
+    std::string source;
+    for (int i = 0; i < 2000; ++i) source += "+++[>++<-]>.[-]++";
+    std::string expected, actual;
+    std::vector<uint8_t> plainCells(8, 0), slicedCells(8, 0);
+    size_t plainPtr = 0, slicedPtr = 0;
+    for (bool optimize : {false, true}) {
+        std::string code = source;
+        goof2::StringSink sink(optimize ? actual : expected);
+        goof2::execute<uint8_t>(optimize ? slicedCells : plainCells,
+                                optimize ? slicedPtr : plainPtr, code, optimize, 0, true, false,
+                                goof2::MemoryModel::Auto, nullptr, nullptr,
+                                goof2::FlushPolicy::Auto, nullptr, &sink);
+    }
+    assert(actual == expected);
+    const size_t size = std::max(plainCells.size(), slicedCells.size());
+    plainCells.resize(size);
+    slicedCells.resize(size);
+    assert(slicedPtr == plainPtr && slicedCells == plainCells);
+    goof2::setSliceSize(std::size_t(1) << 18);
+}
+
+static void test_concurrent_runs() {
+    goof2::InstructionCache cache;
+    const std::string upper = ",[--------------------------------.,]";
+    std::vector<char> ok(4, 1);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ok.size(); ++t) {
+        threads.emplace_back([&, t] {
+            const std::string input(200, static_cast<char>('a' + t));
+            const std::string expected(200, static_cast<char>('A' + t));
+            for (int i = 0; i < 50; ++i) {
+                std::vector<uint8_t> cells(8, 0);
+                size_t ptr = 0;
+                std::string code = upper;
+                goof2::SpanSource in(input);
+                std::string out;
+                goof2::StringSink sink(out);
+                goof2::execute<uint8_t>(cells, ptr, code, true, 1, true, false,
+                                        goof2::MemoryModel::Auto, nullptr, &cache,
+                                        goof2::FlushPolicy::Auto, &in, &sink);
+                if (out != expected) ok[t] = 0;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    assert(std::count(ok.begin(), ok.end(), 1) == 4);
+    assert(cache.size() == 1);
+}
+
+static void test_long_pointer_move() {
+    // More than 32767 cells of pointer movement with no loop in between.
+    for (bool optimize : {false, true}) {
+        std::vector<uint8_t> cells(40001, 0);
+        size_t ptr = 0;
+        std::string code = std::string(40000, '>') + "+<+";
+        goof2::execute<uint8_t>(cells, ptr, code, optimize, 0, false, false,
+                                goof2::MemoryModel::Auto);
+        assert(ptr == 39999 && cells[40000] == 1 && cells[39999] == 1);
+    }
+}
+
+// A session compiles each slice once: an edited program reuses every slice but the edited one
+// and still runs like the program compiled from scratch.
+static void test_compile_session() {
+    std::string source;
+    for (int i = 0; i < 400; ++i) source += "+++[>++<-]>.[-]<[-]";
+    std::string edited = source;
+    edited.insert(edited.size() / 2, "+");
+    goof2::CompileSession session;
+    size_t compiled = 0;
+    for (const std::string& program : {source, edited, edited}) {
+        std::string expected, actual;
+        for (bool useSession : {false, true}) {
+            std::vector<uint8_t> cells(8, 0);
+            size_t ptr = 0;
+            std::string code = program;
+            goof2::StringSink sink(useSession ? actual : expected);
+            if (useSession)
+                goof2::execute<uint8_t>(cells, ptr, code, session, true, 0, true, false,
+                                        goof2::MemoryModel::Auto, nullptr,
+                                        goof2::FlushPolicy::Auto, nullptr, &sink);
+            else
+                goof2::execute<uint8_t>(cells, ptr, code, true, 0, true, false,
+                                        goof2::MemoryModel::Auto, nullptr, nullptr,
+                                        goof2::FlushPolicy::Auto, nullptr, &sink);
+        }
+        assert(actual == expected);
+        if (compiled) assert(session.slices.size() <= compiled + 1);
+        compiled = session.slices.size();
+    }
+    assert(compiled > 2 && session.programs.size() == 2);
+}
+
+// Every level runs a program the same way; higher levels leave fewer instructions.
+static void test_opt_levels() {
+    const std::string program =
+        "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.[-]>[->+>++<<]>>>.<<<"
+        "[-]>[-]>[-]+>+>+[<]>[>]<.";
+    auto instructionCount = [](std::string code, goof2::OptLevel level) {
+        goof2::setOptLevel(level);
+        goof2::InstructionCache cache;
+        goof2::compile<uint8_t>(code, cache, true, 0, true, false);
+        return cache.begin()->second.instructions->size();
+    };
+    std::string expected;
+    std::vector<uint8_t> expectedCells;
+    for (goof2::OptLevel level : {goof2::OptLevel::O0, goof2::OptLevel::O1, goof2::OptLevel::O2,
+                                  goof2::OptLevel::O3, goof2::OptLevel::Auto}) {
+        goof2::setOptLevel(level);
+        std::vector<uint8_t> cells(16, 0);
+        size_t ptr = 0;
+        std::string code = program, out;
+        goof2::StringSink sink(out);
+        goof2::execute<uint8_t>(cells, ptr, code, true, 0, false, false,
+                                goof2::MemoryModel::Auto, nullptr, nullptr,
+                                goof2::FlushPolicy::Auto, nullptr, &sink);
+        if (level == goof2::OptLevel::O0) {
+            expected = out;
+            expectedCells = cells;
+        }
+        assert(out == expected && cells == expectedCells);
+    }
+    const size_t o0 = instructionCount(program, goof2::OptLevel::O0);
+    const size_t o1 = instructionCount(program, goof2::OptLevel::O1);
+    const size_t o2 = instructionCount(program, goof2::OptLevel::O2);
+    const size_t o3 = instructionCount(program, goof2::OptLevel::O3);
+    assert(o0 > o1 && o1 > o2 && o2 > o3);
+    // Auto leaves a program without loops at O0.
+    assert(instructionCount("+-+.", goof2::OptLevel::Auto) ==
+           instructionCount("+-+.", goof2::OptLevel::O0));
+    assert(instructionCount("+-+.", goof2::OptLevel::O0) >
+           instructionCount("+-+.", goof2::OptLevel::O1));
+    goof2::setOptLevel(goof2::OptLevel::O3);
+}
+
+// A fresh tape is known to be zero, so a leading comment loop, loops entered on a cleared cell
+// and scans over cells set before them fold away; the REPL, which keeps its cells, folds none.
+static void test_known_tape() {
+    const std::string program =
+        "[comment, loop.]++++>+++<[->+<]>[->++<]>.[-]<[-]>+>+>+<<<+[>]<[<]>[-]>.";
+    auto run = [&program](bool term) {
+        std::vector<uint8_t> cells(16, 0);
+        size_t ptr = 0;
+        std::string code = program, out;
+        goof2::StringSink sink(out);
+        goof2::execute<uint8_t>(cells, ptr, code, true, 0, false, term, goof2::MemoryModel::Auto,
+                                nullptr, nullptr, goof2::FlushPolicy::Auto, nullptr, &sink);
+        return std::make_pair(out, cells);
+    };
+    auto instructionCount = [&program](bool term) {
+        goof2::InstructionCache cache;
+        std::string code = program;
+        goof2::compile<uint8_t>(code, cache, true, 0, false, term);
+        return cache.begin()->second.instructions->size();
+    };
+    assert(run(false) == run(true));
+    assert(instructionCount(false) < instructionCount(true));
+    goof2::OptReport report;
+    std::string code = program;
+    goof2::InstructionCache cache;
+    goof2::compile<uint8_t>(code, cache, true, 0, false, false, &report);
+    assert(report.deadLoops >= 1);
+    // A tape handed in with values is not assumed to be zero.
+    std::vector<uint8_t> cells(4, 0);
+    cells[0] = 2;
+    size_t ptr = 0;
+    code = "[>+<-]+";
+    goof2::execute<uint8_t>(cells, ptr, code, true, 0, false, false);
+    assert(cells[0] == 1 && cells[1] == 2);
+}
+
+// The start of a program up to its first read runs at compile time and is replaced by its output
+// and the tape it leaves, with the same result for any budget, also when the budget runs out.
+template <typename CellT>
+static void test_compile_time_eval() {
+    const std::string greet = "++++++++[>+++++++++<-]>.<+++++[>++++++<-]>+.[-]++++++++++.";
+    for (const std::string program : {greet, greet + ">,[.,]<<+[>+<-]", greet + "+[>+<-]>>,."}) {
+        std::string expected;
+        std::vector<CellT> expectedCells;
+        size_t expectedPtr = 0;
+        for (uint64_t budget : {uint64_t(0), uint64_t(1), uint64_t(10), uint64_t(1) << 20}) {
+            goof2::setEvalBudget(budget);
+            std::vector<CellT> cells(16, 0);
+            size_t ptr = 0;
+            std::string code = program, out;
+            goof2::SpanSource in("abc");
+            goof2::StringSink sink(out);
+            const int ret = goof2::execute<CellT>(cells, ptr, code, true, 1, false, false,
+                                                  goof2::MemoryModel::Auto, nullptr, nullptr,
+                                                  goof2::FlushPolicy::Auto, &in, &sink);
+            assert(ret == 0);
+            if (budget == 0) {
+                expected = out;
+                expectedCells = cells;
+                expectedPtr = ptr;
+            }
+            assert(out == expected && cells == expectedCells && ptr == expectedPtr);
+            (void)ret;
+        }
+    }
+    auto instructionCount = [&greet](uint64_t budget) {
+        goof2::setEvalBudget(budget);
+        goof2::InstructionCache cache;
+        std::string code = greet;
+        goof2::compile<CellT>(code, cache, true, 0, false, false);
+        return cache.begin()->second.instructions->size();
+    };
+    // WRITE_STR and the slot holding its bytes, a move to the cell left at 10, its set and END.
+    assert(instructionCount(uint64_t(1) << 20) == 5);
+    assert(instructionCount(0) > 5);
+    goof2::setEvalBudget(uint64_t(1) << 20);
+}
+
+// Output from several cells in a row is written as one block, and as a literal when the cells
+// hold known values; either way it matches the output of -O2, which writes it cell by cell.
+static void test_output_runs() {
+    auto run = [](const std::string& program, goof2::OptLevel level, bool& merged) {
+        goof2::setOptLevel(level);
+        std::vector<uint8_t> cells(8, 0);
+        size_t ptr = 0;
+        std::string code = program, out;
+        goof2::SpanSource in("abc");
+        goof2::StringSink sink(out);
+        goof2::InstructionCache cache;
+        goof2::execute<uint8_t>(cells, ptr, code, true, 0, false, false,
+                                goof2::MemoryModel::Auto, nullptr, &cache,
+                                goof2::FlushPolicy::Auto, &in, &sink);
+        merged = false;
+        for (const instruction& inst : *cache.begin()->second.instructions)
+            merged |= inst.op == insType::PUT_STR || inst.op == insType::WRITE_STR;
+        return out;
+    };
+    bool merged = false;
+    for (const std::string program : {",>,>,<<.>.>..<<.", ",[-]+++>[-]++<.>..[-.]"}) {
+        const std::string expected = run(program, goof2::OptLevel::O2, merged);
+        assert(!merged);
+        assert(run(program, goof2::OptLevel::O3, merged) == expected);
+        assert(merged);
+    }
+    goof2::setOptLevel(goof2::OptLevel::O3);
+}
+
+// A loop that ends every iteration on the cell it tests keeps the pointer offset pending before
+// it, so from -O2 it runs without moving the pointer, on fixed and growing tapes alike.
+static void test_balanced_loop_offsets() {
+    const std::string program = ">>>+++[<++[>>+<<-]>-]<.>>>[-<<<+>>>]+++[-]<<<.";
+    auto ptrMoves = [&program](goof2::OptLevel level) {
+        goof2::setOptLevel(level);
+        goof2::InstructionCache cache;
+        std::string code = program;
+        goof2::compile<uint8_t>(code, cache, true, 0, false, true);
+        size_t moves = 0;
+        for (const instruction& inst : *cache.begin()->second.instructions)
+            moves += inst.op == insType::PTR_MOV;
+        return moves;
+    };
+    for (bool dynamic : {false, true}) {
+        std::string expected;
+        std::vector<uint8_t> expectedCells;
+        for (goof2::OptLevel level : {goof2::OptLevel::O1, goof2::OptLevel::O2}) {
+            goof2::setOptLevel(level);
+            std::vector<uint8_t> cells(dynamic ? 1 : 8, 0);
+            size_t ptr = 0;
+            std::string code = program, out;
+            goof2::StringSink sink(out);
+            goof2::execute<uint8_t>(cells, ptr, code, true, 0, dynamic, true,
+                                    goof2::MemoryModel::Auto, nullptr, nullptr,
+                                    goof2::FlushPolicy::Auto, nullptr, &sink);
+            cells.resize(8);
+            if (level == goof2::OptLevel::O1) {
+                expected = out;
+                expectedCells = cells;
+            }
+            assert(out == expected && cells == expectedCells && ptr == 2);
+        }
+    }
+    assert(ptrMoves(goof2::OptLevel::O1) > 1);
+    assert(ptrMoves(goof2::OptLevel::O2) == 1);
+    goof2::setOptLevel(goof2::OptLevel::O3);
+}
+
+// Loops that end by clearing the cell they test run at most once. From -O2 they compile to a
+// block skipped when that cell is zero, and behave as the loops do at -O1 for either input.
+static void test_if_loops() {
+    const std::string program = ",[>+++[<++>-]<.[-]]>>,[<+>[-]]<.>>,[.<[-]>[-]]<<.>>.";
+    auto run = [&program](goof2::OptLevel level, const std::string& input, size_t& skips) {
+        goof2::setOptLevel(level);
+        std::vector<uint8_t> cells(8, 0);
+        size_t ptr = 0;
+        std::string code = program, out;
+        goof2::SpanSource in(input);
+        goof2::StringSink sink(out);
+        goof2::InstructionCache cache;
+        goof2::execute<uint8_t>(cells, ptr, code, true, 0, false, false,
+                                goof2::MemoryModel::Auto, nullptr, &cache,
+                                goof2::FlushPolicy::Auto, &in, &sink);
+        skips = 0;
+        for (const instruction& inst : *cache.begin()->second.instructions)
+            skips += inst.op == insType::SKP_ZER;
+        return out + std::string(cells.begin(), cells.end());
+    };
+    size_t skips = 0;
+    for (const std::string input : {std::string("abc"), std::string("\0b\0", 3)}) {
+        const std::string expected = run(goof2::OptLevel::O1, input, skips);
+        assert(skips == 0);
+        for (goof2::OptLevel level : {goof2::OptLevel::O2, goof2::OptLevel::O3}) {
+            assert(run(level, input, skips) == expected);
+            assert(skips == 3);
+        }
+    }
+    goof2::setOptLevel(goof2::OptLevel::O3);
+}
+
+// The report counts the idioms folded and places every innermost loop left at its '[' in the
+// source, also when the source is compiled in slices.
+static void test_opt_report() {
+    const std::string block = "copy [->+<] clear [-] scan [>] left +[>.<-] odd [>+<--]\n";
+    std::string source;
+    for (int i = 0; i < 64; ++i) source += block;
+    for (size_t slice : {size_t(1) << 18, size_t(128)}) {
+        goof2::setSliceSize(slice);
+        goof2::clearLoopCache();
+        goof2::InstructionCache cache;
+        goof2::OptReport report;
+        std::string code = source;
+        assert(goof2::compile<uint8_t>(code, cache, true, 0, true, false, &report) == 0);
+        assert(report.copyLoops == 64 && report.clearLoops == 64 && report.scanLoops == 64);
+        assert(report.loopsLeft == 128 && report.missed.size() == 128);
+        assert(report.loopCacheHits + report.loopCacheMisses == 128);
+        for (size_t i = 0; i < report.missed.size(); ++i) {
+            const goof2::OptRemark& remark = report.missed[i];
+            const size_t expected =
+                i / 2 * block.size() + block.find(i % 2 ? "[>+<--]" : "[>.<-]");
+            assert(remark.offset == expected);
+            assert(remark.reason == (i % 2 ? "changes the cell it tests by -2 per iteration"
+                                           : "does input or output"));
+        }
+    }
+    goof2::setSliceSize(size_t(1) << 18);
+}
+
+// Loops of the shapes in an idiom file are replaced before the built-in idioms are looked for,
+// and the report counts each idiom and places the loops its templates leave at the loop replaced.
+static void test_idioms() {
+    const std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "goof2-test.idioms";
+    std::ofstream(path) << "# in-house helpers\n"
+                           "copy2 [->a+<a] [->a++<a]\n"
+                           "  wipe   [-[-]]   clear\n"
+                           "\n"
+                           "echo [-.] [.-]\n";
+    std::string err;
+    assert(goof2::loadIdioms(path.string(), err));
+    std::vector<uint8_t> cells(4, 0);
+    size_t ptr = 0;
+    run<uint8_t>(",[->>+<<]", cells, ptr, "\5");
+    assert(cells[0] == 0 && cells[2] == 10);
+    // The two runs a stands for differ, so this loop is left alone.
+    cells.assign(4, 0);
+    ptr = 0;
+    run<uint8_t>(",[->>+<]", cells, ptr, "\1");
+    assert(cells[0] == 0 && cells[2] == 1 && ptr == 1);
+
+    const std::string source = "+++[-[-]]>+[-.]>,[>+<--]";
+    std::string code = source;
+    goof2::InstructionCache cache;
+    goof2::OptReport report;
+    assert(goof2::compile<uint8_t>(code, cache, true, 0, true, false, &report) == 0);
+    assert(report.idiomHits.size() == 3);
+    assert(report.idiomHits[0].second == 0 && report.idiomHits[1].second == 1);
+    assert(report.idiomHits[2] == std::make_pair(std::string("echo"), std::uint64_t(1)));
+    assert(report.missed.size() == 2);
+    assert(report.missed[0].offset == source.find("[-.]"));
+    assert(report.missed[0].reason == "does input or output");
+    assert(report.missed[1].offset == source.find("[>+<--]"));
+
+    // A file that does not parse leaves the idioms loaded before.
+    std::ofstream(path) << "copy2 [->a+<a] [->a++<a]\nbad [->a+<b] >c\n";
+    assert(!goof2::loadIdioms(path.string(), err));
+    assert(err.starts_with("line 2: "));
+    assert(!goof2::loadIdioms((path / "missing").string(), err));
+    for (const uint8_t expected : {10, 5}) {
+        cells.assign(4, 0);
+        ptr = 0;
+        run<uint8_t>(",[->>+<<]", cells, ptr, "\5");
+        assert(cells[2] == expected);
+        assert(goof2::loadIdioms("", err));
+    }
+    std::filesystem::remove(path);
+}
+
 template <typename CellT>
 static void run_tests() {
     test_loops<CellT>();
     test_io<CellT>();
+    test_block_read<CellT>();
+    test_stream_copy<CellT>();
     test_wrapping<CellT>();
     test_eof_behavior<CellT>();
     test_boundary_checks<CellT>();
@@ -275,10 +1028,15 @@ static void run_tests() {
     test_scan_clear<CellT>();
     test_clr_range<CellT>();
     test_clr_then_set<CellT>();
+    test_divmod<CellT>();
+    test_nested_loops<CellT>();
     test_unmatched_brackets<CellT>();
+    test_long_runs<CellT>();
     test_mul_cpy<CellT>();
+    test_closed_form_loops<CellT>();
     test_cache_reuse<CellT>();
     test_loop_cache_reuse<CellT>();
+    test_rewrite_order<CellT>();
 }
 
 int main() {
@@ -286,5 +1044,21 @@ int main() {
     run_tests<uint16_t>();
     run_tests<uint32_t>();
     run_tests<uint64_t>();
+    test_instruction_limit();
+    test_flush_policy();
+    test_io_interfaces();
+    test_sliced_compile();
+    test_concurrent_runs();
+    test_long_pointer_move();
+    test_compile_session();
+    test_opt_levels();
+    test_known_tape();
+    test_compile_time_eval<uint8_t>();
+    test_compile_time_eval<uint32_t>();
+    test_output_runs();
+    test_balanced_loop_offsets();
+    test_if_loops();
+    test_opt_report();
+    test_idioms();
     return 0;
 }
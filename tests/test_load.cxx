@@ -43,6 +43,38 @@ static void test_load_file() {
     std::remove(fname);
 }
 
+static void test_load_source() {
+    // Large enough to be split into several chunks, with commands on both sides of each boundary.
+    std::string raw;
+    std::string expected;
+    const std::string piece = "+ a[b->c<]d.e,f\n\xff;;comment;; ";
+    while (raw.size() < (size_t(9) << 20)) {
+        raw += piece;
+        expected += "+[-><].,";
+    }
+    raw += "+";
+    expected += "+";
+    const char* fname = "test_large.bf";
+    {
+        std::ofstream f(fname, std::ios::binary);
+        f << raw;
+    }
+    std::string code, err;
+    bool loaded = goof2::loadSource(fname, code, err);
+    assert(loaded && code == expected);
+    std::remove(fname);
+
+    // Filtering in place keeps only the commands.
+    std::string small = "x+y-z[>]<.,!";
+    small.resize(goof2::filterSource(small.data(), small.size(), small.data()));
+    assert(small == "+-[>]<.,");
+
+    code = "unchanged";
+    loaded = goof2::loadSource("does_not_exist.bf", code, err);
+    assert(!loaded && !err.empty() && code == "unchanged");
+    (void)loaded;
+}
+
 template <typename CellT>
 static void run_tests() {
     test_load_file<CellT>();
@@ -53,5 +85,6 @@ int main() {
     run_tests<uint16_t>();
     run_tests<uint32_t>();
     run_tests<uint64_t>();
+    test_load_source();
     return 0;
 }
@@ -17,12 +17,58 @@ static void run_model(goof2::MemoryModel model, std::size_t expectedSize) {
     if (expectedSize) assert(cells.size() == expectedSize);
 }
 
+#if GOOF2_HAS_OS_VM
+static void test_forked_tapes() {
+    // Shared setup phase, then fan out over continuations.
+    std::vector<uint8_t> cells(100, 0);
+    size_t ptr = 0;
+    std::string setup = "+++++[>++++++++<-]>";
+    int ret = goof2::execute<uint8_t>(cells, ptr, setup, true, 0, true, true);
+    assert(ret == 0);
+    goof2::TapeSnapshot<uint8_t> snap(cells, ptr);
+    assert(snap);
+    assert(snap.cellPtr() == 1);
+
+    auto a = snap.fork();
+    auto b = snap.fork();
+    assert(a && b);
+    std::string incA = "++";
+    std::string incB = "-[-]>+";
+    ret = goof2::execute<uint8_t>(a, incA);
+    assert(ret == 0);
+    ret = goof2::execute<uint8_t>(b, incB);
+    assert(ret == 0);
+    assert(a[1] == 42 && a.cellPtr == 1);
+    assert(b[1] == 0 && b[2] == 1 && b.cellPtr == 2);
+
+    // Children never observe each other's writes.
+    auto c = snap.fork();
+    assert(c[1] == 40 && c[2] == 0);
+
+    // Growing past the snapshot keeps the existing contents.
+    std::string far = "[>]+";
+    ret = goof2::execute<uint8_t>(c, far);
+    assert(ret == 0);
+    assert(c.cellPtr == 2);
+    std::string jump(cells.size() + 10, '>');
+    jump += '+';
+    ret = goof2::execute<uint8_t>(c, jump);
+    assert(ret == 0);
+    assert(c.size > cells.size());
+    assert(c[1] == 40 && c[2] == 1 && c[c.cellPtr] == 1);
+    (void)ret;
+}
+#endif
+
 int main() {
     run_model(goof2::MemoryModel::Contiguous, 2);
     run_model(goof2::MemoryModel::Fibonacci, 2);
     run_model(goof2::MemoryModel::Paged, 65536);
 #if defined(_WIN32) || defined(__unix__) || defined(__APPLE__)
     run_model(goof2::MemoryModel::OSBacked, 0);
+#endif
+#if GOOF2_HAS_OS_VM
+    test_forked_tapes();
 #endif
     return 0;
 }
@@ -0,0 +1,94 @@
+// Starts `goof2 --serve` on a temporary socket and checks that requests are executed and their
+// output streamed back.
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "helpers.hxx"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int connectTo(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        assert(fd >= 0);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return fd;
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// Sends msg as the whole request and returns everything the server answers.
+static std::string exchange(const std::string& path, const std::string& msg) {
+    int fd = connectTo(path);
+    assert(fd >= 0);
+    const ssize_t sent = write(fd, msg.data(), msg.size());
+    assert(sent == static_cast<ssize_t>(msg.size()));
+    (void)sent;
+    shutdown(fd, SHUT_WR);
+    std::array<char, 256> buf{};
+    std::string out;
+    ssize_t n;
+    while ((n = read(fd, buf.data(), buf.size())) > 0) out.append(buf.data(), n);
+    close(fd);
+    return out;
+}
+
+static std::string request(const std::string& path, const std::string& code,
+                           const std::string& input = "", const std::string& options = "") {
+    std::string msg = std::to_string(code.size()) + " " + std::to_string(input.size());
+    if (!options.empty()) msg += " " + options;
+    return exchange(path, msg + "\n" + code + input);
+}
+
+int main() {
+    const std::string path = "/tmp/goof2-serve-test-" + std::to_string(getpid()) + ".sock";
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        execl(GOOF2_EXE_PATH, GOOF2_EXE_PATH, "--serve", path.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    const std::string helloA = "++++++++[>++++++++<-]>+.";  // prints 'A'
+    std::string out = request(path, helloA);
+    assert(hashOutput(out) == 0x13099d40d095b684ULL);
+    out = request(path, helloA);
+    assert(hashOutput(out) == 0x13099d40d095b684ULL);
+    // Options in the request override the server's.
+    out = request(path, helloA, "", "-nopt");
+    assert(hashOutput(out) == 0x13099d40d095b684ULL);
+    out = request(path, ",.", "A", "-eof 1 -cw 16");
+    assert(hashOutput(out) == 0x13099d40d095b684ULL);
+    out = request(path, "+[");
+    assert(out == "ERROR: Unmatched open bracket\n");
+    out = request(path, "+", "", "-bogus");
+    assert(out.rfind("ERROR: Unknown option", 0) == 0);
+    // A program that fails at run time is reported too.
+    out = request(path, "+.<");
+    assert(out == "\x01" "ERROR: Program stopped with an error\n");
+    // A header alone may not claim more than a request can carry.
+    out = exchange(path, "1073741824 0\n");
+    assert(out == "ERROR: Request payload too large\n");
+
+    kill(pid, SIGTERM);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    // The socket file is removed on shutdown.
+    assert(access(path.c_str(), F_OK) != 0);
+    return 0;
+}